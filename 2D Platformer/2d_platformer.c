@@ -1,722 +1,4836 @@
 #include <SDL2/SDL.h>
+#include <stdarg.h>
 #include <stdbool.h>
-#include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_image.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#include "level_format.h"
+#include "asset_format.h"
+#include "font_format.h"
+#include "platformer_env.h"
+
+// Built with -DCOUNT_ALLOCS, every heap allocation is counted, the game's own through these
+// macros and SDL's through its memory functions, so frames that should allocate nothing can be
+// checked. Off by default, normal builds allocate straight from the C library and SDL
+#ifdef COUNT_ALLOCS
+SDL_atomic_t allocationCount;
+#define COUNT_ALLOCATION() SDL_AtomicIncRef(&allocationCount)
+#define malloc(size) (COUNT_ALLOCATION(), malloc(size))
+#define calloc(count, size) (COUNT_ALLOCATION(), calloc(count, size))
+#define realloc(block, size) (COUNT_ALLOCATION(), realloc(block, size))
+#define ALLOCATION_WARMUP_FRAMES 60     // loading finishes in these, after that frames report allocations
+#endif
 
 // Constants
 const int WINDOW_WIDTH = 800;
 const int WINDOW_HEIGHT = 600;
 const int GROUND_HEIGHT = 75;
-const float START_X = 200;
-const float START_Y = 100;
-const int LEVEL_WIDTH = 2000; 
+
+// Level to load, built from levels/level1.txt with levelc
+#define LEVEL_PATH "levels/level1.lvl"
+
+// Simulation runs at a fixed rate, rendering runs as fast as vsync allows. Speeds are tuned
+// in pixels per REFERENCE_TICK_RATE tick and scaled to TICK_RATE as they're integrated, so a
+// build with -DTICK_RATE=30 for weak devices plays the same at half the CPU
+#ifndef TICK_RATE
+#define TICK_RATE 60
+#endif
+#define REFERENCE_TICK_RATE 60
+#define REFERENCE_TICKS(n) SDL_max((n) * TICK_RATE / REFERENCE_TICK_RATE, 1)
+const double TICK_DT = 1.0 / TICK_RATE;
+const float TICK_SCALE = (float)REFERENCE_TICK_RATE / TICK_RATE;   // reference ticks per tick
+const double MAX_FRAME_TIME = 0.25;     // clamp so a long stall doesn't spiral
+const int MAX_TICKS_PER_FRAME = 15;     // catch-up limit per rendered frame
 
 // Global variables
-SDL_Rect camera = { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
-int score = 0;
 SDL_Window *window = NULL;
 SDL_Renderer *renderer = NULL;
-TTF_Font *font = NULL;
 
-// Textures for player and enemies
-SDL_Texture *playerTexture = NULL;
-SDL_Texture *enemyTexture = NULL;
-SDL_Texture *coinTexture = NULL; 
-SDL_Texture *terrainTexture = NULL;
-SDL_Texture *platformTexture = NULL;
-SDL_Texture *bgTexture = NULL;
-SDL_Texture *goalTexture = NULL;
+// Texture atlas: every sprite sheet is packed into a few big pages at load time
+#define ATLAS_PAGE_SIZE 1024
+#define MAX_ATLAS_PAGES 4
+#define ATLAS_PADDING 1        // empty pixels between sheets so sampling never bleeds
 
-// Type definitions
-#define MAX_COINS 10
 typedef struct {
-    float x, y;
+    SDL_Texture *texture;
     int w, h;
-    bool collected;
-    int frame;
-    int frameTimer;
-    int frameDelay;
-    int totalFrames;
-    int frameWidth, frameHeight;
-} Coin;
-
-Coin coins[MAX_COINS] = {
-    {250, 400,60,60, false,0,0,8,17,16,16},
-    {430, 300,60,60, false,0,0,8,17,16,16},
-    {620, 200,60,60, false,0,0,8,17,16,16},
-    {120, 100,60,60, false,0,0,8,17,16,16},
-    {310, 860,60,60, false,0,0,8,17,16,16},
-    {750, 400,60,60, false,0,0,8,17,16,16},
-    {980, 360,60,60, false,0,0,8,17,16,16},
-    {1130, 240,60,60, false,0,0,8,17,16,16},
-    {1330, 150,60,60, false,0,0,8,17,16,16},
-    {1550, 100,60,60, false,0,0,8,17,16,16},
+} AtlasPage;
+
+typedef struct {
+    AtlasPage *page;
+    SDL_Rect rect;             // where the sheet sits on its page
+    int frameW, frameH;        // animation frame size, the whole sheet if it isn't animated
+} Sprite;
+
+typedef struct {
+    const char *path;
+    Sprite *sprite;
+    bool critical;             // the game waits for it before the first frame
+} SpriteSheet;
+
+AtlasPage atlasPages[MAX_ATLAS_PAGES];
+int atlasPageCount = 0;
+int atlasShelfX = 0, atlasShelfY = 0, atlasShelfHeight = 0;   // packing position on the last page
+
+// Sprites for player and enemies
+Sprite playerSprite;
+Sprite enemySprites[LEVEL_ENEMY_TYPE_COUNT];
+Sprite bulletSprites[LEVEL_ENEMY_TYPE_COUNT];  // only the types that shoot have one
+Sprite coinSprite;
+Sprite terrainSprite;
+Sprite platformSprite;
+Sprite bgSprite;
+Sprite goalSprite;
+
+// Sheets packed into the atlas, add a line here to make a new PNG drawable.
+// Non-critical sheets may arrive after play starts, until then they just aren't drawn
+SpriteSheet spriteSheets[] = {
+    {"assets/Pixel Adevnture/Main Characters/Virtual Guy/Run (32x32).png", &playerSprite, true},
+    {"assets/Pixel Adevnture/Items/Checkpoints/End/End (Idle).png", &goalSprite, false},
+    {"assets/Pixel Adevnture/Background/Blue.png", &bgSprite, false},
+    {"assets/Terrain (16x16).png", &terrainSprite, true},
+    {"assets/Pixel Adevnture/Enemies/AngryPig/Walk (36x30).png", &enemySprites[LEVEL_ENEMY_ANGRYPIG], true},
+    {"assets/Pixel Adevnture/Enemies/Bat/Flying (46x30).png", &enemySprites[LEVEL_ENEMY_BAT], true},
+    {"assets/Pixel Adevnture/Enemies/Bee/Idle (36x34).png", &enemySprites[LEVEL_ENEMY_BEE], true},
+    {"assets/Pixel Adevnture/Enemies/BlueBird/Flying (32x32).png", &enemySprites[LEVEL_ENEMY_BLUEBIRD], true},
+    {"assets/Pixel Adevnture/Enemies/Bunny/Run (34x44).png", &enemySprites[LEVEL_ENEMY_BUNNY], true},
+    {"assets/Pixel Adevnture/Enemies/Chameleon/Run (84x38).png", &enemySprites[LEVEL_ENEMY_CHAMELEON], true},
+    {"assets/Pixel Adevnture/Enemies/Chicken/Run (32x34).png", &enemySprites[LEVEL_ENEMY_CHICKEN], true},
+    {"assets/Pixel Adevnture/Enemies/Duck/Idle (36x36).png", &enemySprites[LEVEL_ENEMY_DUCK], true},
+    {"assets/Pixel Adevnture/Enemies/FatBird/Idle (40x48).png", &enemySprites[LEVEL_ENEMY_FATBIRD], true},
+    {"assets/Pixel Adevnture/Enemies/Ghost/Idle (44x30).png", &enemySprites[LEVEL_ENEMY_GHOST], true},
+    {"assets/Pixel Adevnture/Enemies/Mushroom/Run (32x32).png", &enemySprites[LEVEL_ENEMY_MUSHROOM], true},
+    {"assets/Pixel Adevnture/Enemies/Plant/Idle (44x42).png", &enemySprites[LEVEL_ENEMY_PLANT], true},
+    {"assets/Pixel Adevnture/Enemies/Radish/Run (30x38).png", &enemySprites[LEVEL_ENEMY_RADISH], true},
+    {"assets/Pixel Adevnture/Enemies/Rino/Run (52x34).png", &enemySprites[LEVEL_ENEMY_RINO], true},
+    {"assets/Pixel Adevnture/Enemies/Rocks/Rock1_Run (38x34).png", &enemySprites[LEVEL_ENEMY_ROCKS], true},
+    {"assets/Pixel Adevnture/Enemies/Skull/Idle 1 (52x54).png", &enemySprites[LEVEL_ENEMY_SKULL], true},
+    {"assets/Pixel Adevnture/Enemies/Slime/Idle-Run (44x30).png", &enemySprites[LEVEL_ENEMY_SLIME], true},
+    {"assets/Pixel Adevnture/Enemies/Snail/Walk (38x24).png", &enemySprites[LEVEL_ENEMY_SNAIL], true},
+    {"assets/Pixel Adevnture/Enemies/Trunk/Run (64x32).png", &enemySprites[LEVEL_ENEMY_TRUNK], true},
+    {"assets/Pixel Adevnture/Enemies/Turtle/Idle 1 (44x26).png", &enemySprites[LEVEL_ENEMY_TURTLE], true},
+    {"assets/Pixel Adevnture/Enemies/Bee/Bullet.png", &bulletSprites[LEVEL_ENEMY_BEE], true},
+    {"assets/Pixel Adevnture/Enemies/Plant/Bullet.png", &bulletSprites[LEVEL_ENEMY_PLANT], true},
+    {"assets/Pixel Adevnture/Enemies/Trunk/Bullet.png", &bulletSprites[LEVEL_ENEMY_TRUNK], true},
+    {"assets/Pixel Adevnture/Items/Fruits/Apple.png", &coinSprite, true},
+    {"assets/Pixel Adevnture/Terrain/Terrain (16x16).png", &platformSprite, true},
 };
+#define SPRITE_SHEET_COUNT (int)(sizeof(spriteSheets) / sizeof(spriteSheets[0]))
 
-#define MAX_ENEMIES 3
+// Animation clips: a strip of equal frames along one sheet, looped. Nothing is stepped per
+// tick, an entity only keeps the tick its clip started and the frame is worked out when it's
+// drawn. A zero frame size takes the sheet's own, the frame count comes from the sheet width
 typedef struct {
-    float x, y;
-    int w, h;
-    float vx;
-    bool facingLeft;
-    int frame;             // Animation frame
-    int frameTimer;        // Timer for animation
-    int frameDelay;        // Animation speed
-    int totalFrames;       // Total animation frames
-    float patrolStart;     // Patrol boundary - start
-    float patrolEnd;       // Patrol boundary - end
-} Enemy;
-
-Enemy enemies[MAX_ENEMIES] = {
-    {600, 420, 40, 40, 1.0f, false, 0, 0, 6, 9, 500, 700},
-    {900, 420, 40, 40, -1.0f, true, 0, 0, 6, 9, 800, 1000},
-    {1300, 420, 40, 40, 0.8f, false, 0, 0, 6, 9, 1200, 1400}
+    Sprite *sprite;
+    int frameW, frameH;
+    int ticksPerFrame;
+    int frameCount;            // set by initClips once the sheets are loaded
+} AnimClip;
+
+typedef enum {
+    CLIP_PLAYER_RUN,
+    CLIP_COIN,
+    CLIP_COUNT
+} ClipId;
+
+AnimClip clips[CLIP_COUNT] = {
+    [CLIP_PLAYER_RUN] = { &playerSprite, 0, 0, REFERENCE_TICKS(6) },
+    [CLIP_COIN] = { &coinSprite, 32, 32, REFERENCE_TICKS(8) },
 };
 
-#define MAX_PLATFORMS 10
-typedef struct {
-    SDL_Rect rect;
-    bool isActive;
-} Platform;
-
-Platform platforms[MAX_PLATFORMS] = {
-    {{250, 450, 120, 20}, true},
-    {{400, 350, 150, 20}, true},
-    {{600, 250, 100, 20}, true},
-    {{100, 250, 180, 20}, true},
-    {{300, 150, 130, 20}, true},
-    {{980, 500, 50, 20}, true},
-    {{1130, 380, 50, 20}, true},
-    {{1330, 280, 50, 20}, true},
-    {{1550, 150, 50, 20}, true},
-    {{1700, 500, 50, 20}, true}
+AnimClip enemyClips[LEVEL_ENEMY_TYPE_COUNT];   // each type's sheet, filled in by initClips
+
+// Asset loading: PNGs are decoded to RGBA surfaces on a pool of worker threads,
+// the main thread only packs them onto the atlas and uploads them
+#define MAX_DECODE_WORKERS 8
+
+typedef enum {
+    DECODE_PENDING,
+    DECODE_DONE,
+    DECODE_FAILED,
+} DecodeState;
+
+typedef struct {
+    SpriteSheet *sheet;
+    const AssetEntry *entry;   // in the asset archive, NULL to decode the PNG
+    SDL_Surface *surface;      // written by the worker before it publishes state
+    SDL_atomic_t state;        // DecodeState
+    bool uploaded;             // main thread only
+} DecodeJob;
+
+typedef void (*AssetProgressFn)(int loaded, int total);
+
+DecodeJob decodeJobs[SPRITE_SHEET_COUNT];
+int decodeJobCount = 0;
+SDL_atomic_t nextDecodeJob;
+SDL_sem *decodeFinished = NULL;  // posted once per decoded sheet
+SDL_Thread *decodeWorkers[MAX_DECODE_WORKERS];
+int decodeWorkerCount = 0;
+int assetsUploaded = 0;
+Uint64 startupCounter = 0;       // for the startup timing log
+
+// A file mapped read-only, or read into memory where mmap isn't available
+typedef struct {
+    void *data;
+    size_t size;
+} MappedFile;
+
+// Pre-decoded asset archive built by assetpack, used instead of the PNGs when it's there
+#define ASSET_ARCHIVE_PATH "assets.pak"
+MappedFile assetArchive;
+const AssetEntry *assetEntries = NULL;
+int assetEntryCount = 0;
+
+// Sprite batch: quads that share a texture go out in one SDL_RenderGeometry call
+#define MAX_BATCH_QUADS 4096
+SDL_Vertex batchVertices[MAX_BATCH_QUADS * 4];
+int batchIndices[MAX_BATCH_QUADS * 6];
+SDL_Texture *batchTexture = NULL;
+int batchQuads = 0;
+int drawCalls = 0;             // draw calls issued this frame
+
+// Scratch memory for lists and strings that only live for one frame or tick: a bump allocator
+// per thread, reset at the top of every frame on the main thread and every simulated tick.
+// Its block is allocated on first use, after that it never touches the heap
+#define SCRATCH_ARENA_SIZE (1 << 20)
+
+typedef struct {
+    Uint8 *base;
+    size_t used;
+    size_t capacity;
+} Arena;
+
+static _Thread_local Arena scratch;
+
+#define ARENA_ARRAY(arena, type, count) ((type*)arenaAlloc((arena), (size_t)(count) * sizeof(type)))
+
+// Glyph cache: every font size is baked offline by fontbake onto its own page
+#define FONT_PATH "fonts/arial.font"
+#define FIRST_GLYPH FONT_FIRST_GLYPH
+#define LAST_GLYPH FONT_LAST_GLYPH
+#define MAX_GLYPH_FONTS 4
+
+typedef struct {
+    SDL_Rect rect;             // glyph cell on the font's page
+    int advance;
+} Glyph;
+
+typedef struct {
+    int size;
+    int height;
+    AtlasPage page;
+    Glyph glyphs[LAST_GLYPH - FIRST_GLYPH + 1];
+} GlyphFont;
+
+GlyphFont glyphFonts[MAX_GLYPH_FONTS];
+int glyphFontCount = 0;
+
+// A piece of text whose quads are only rebuilt when its string changes
+#define MAX_LABEL_CHARS 64
+typedef struct {
+    GlyphFont *font;
+    char text[MAX_LABEL_CHARS];
+    int x, y;
+    SDL_Color color;
+    int quadCount;
+    SDL_Vertex vertices[MAX_LABEL_CHARS * 4];
+} TextLabel;
+
+#define HUD_FONT_SIZE 24
+#define MESSAGE_FONT_SIZE 48
+GlyphFont *hudFont = NULL;
+GlyphFont *messageFont = NULL;
+TextLabel scoreLabel;
+int scoreLabelValue = -1;      // score the label was last built for
+
+// Input recording and replay. A tick's input is a bitmask; recordings store it as runs of
+// identical ticks followed by a hash of the simulation state after every tick
+#define INPUT_LEFT 0x01
+#define INPUT_RIGHT 0x02
+#define INPUT_JUMP 0x04
+#define INPUT_REWIND 0x08
+
+#define REPLAY_MAGIC 0x4C505250        // "PRPL"
+#define REPLAY_VERSION 8             // 2: deaths and wins hold for MESSAGE_TICKS, 3: hashes animation clocks,
+                                     // 4: resets restore the level start snapshot, 5: ground is a wall
+                                     // below MAX_STEP_UP, 6: swept terrain collision, records TICK_RATE,
+                                     // 7: enemy behaviours and bullets, 8: restores move tick stamps
+                                     // onto the running clock, pit sides are walls below the level
+
+typedef struct {
+    Uint32 magic;
+    Uint32 version;
+    Uint32 levelHash;          // replays only make sense on the level they were recorded on
+    Uint32 tickCount;          // also the number of state hashes after the runs
+    Uint32 runCount;
+    Uint32 tickRate;           // hashes only match a build with the same TICK_RATE
+} ReplayHeader;
+
+typedef struct {
+    Uint16 length;             // ticks, longer stretches take several runs
+    Uint8 input;
+    Uint8 reserved;
+} ReplayRun;
+
+typedef enum {
+    REPLAY_OFF,
+    REPLAY_RECORDING,
+    REPLAY_PLAYING
+} ReplayMode;
+
+ReplayMode replayMode = REPLAY_OFF;
+const char* replayPath = NULL;
+ReplayRun* replayRuns = NULL;
+Uint32* replayHashes = NULL;
+Uint32 replayRunCount = 0, replayRunCapacity = 0;
+Uint32 replayTickCount = 0, replayTickCapacity = 0;
+Uint32 replayTick = 0;                 // next tick to play back
+Uint32 replayRun = 0, replayRunTick = 0;
+Sint64 replayDivergedAt = -1;          // first tick whose hash didn't match
+
+// Headless mode: no window, renderer or textures, the simulation runs flat out
+#define HEADLESS_DEFAULT_TICKS 1000000
+bool headless = false;
+Uint64 headlessTicks = 0;              // 0 runs the whole replay, or the default without one
+Uint32 inputRandom = 1;                // xorshift state, seeded with --seed
+
+// Frame profiler, only built with -DPROFILE. Every thread times its stages into its own
+// ring that only the main thread drains, so recording an event never takes a lock
+#ifdef PROFILE
+#define MAX_PROFILE_THREADS 16
+#define PROFILE_RING_SIZE 4096          // events per thread, power of two
+#define PROFILE_HISTORY 240             // frames shown in the overlay graph
+#define PROFILE_MAX_STAGES 16
+#define PROFILE_CAPTURE_FRAMES 600      // frames written per trace capture
+#define PROFILE_CAPTURE_EVENTS (1 << 18)
+#define PROFILE_TRACE_PATH "trace.json"
+#define PROFILE_PIXELS_PER_MS 3
+
+typedef struct {
+    const char* name;
+    Uint64 start, end;
+} ProfileEvent;
+
+typedef struct {
+    const char* threadName;
+    SDL_atomic_t head;          // only written by the owning thread
+    SDL_atomic_t tail;          // only written by the main thread
+    SDL_atomic_t dropped;       // events lost because the main thread fell behind
+    ProfileEvent events[PROFILE_RING_SIZE];
+} ProfileRing;
+
+typedef struct {
+    ProfileEvent event;
+    int thread;
+} CapturedEvent;
+
+ProfileRing profileRings[MAX_PROFILE_THREADS];
+SDL_atomic_t profileRingCount;
+static _Thread_local ProfileRing* profileRing = NULL;
+
+float profileFrameMs[PROFILE_HISTORY];
+int profileFrameCount = 0;      // newest frame is at (profileFrameCount - 1) % PROFILE_HISTORY
+const char* profileStageNames[PROFILE_MAX_STAGES];
+double profileStageMs[PROFILE_MAX_STAGES];    // main and sim thread time per stage last frame
+int profileStageCount = 0;
+bool profileOverlay = true;
+CapturedEvent* profileCapture = NULL;
+int profileCaptureCount = 0;
+int profileCaptureFramesLeft = 0;
+
+#define PROFILE_THREAD(name) profileRegisterThread(name)
+#define PROFILE_BEGIN(stage) Uint64 profileStart_##stage = SDL_GetPerformanceCounter()
+#define PROFILE_END(stage) profileRecord(#stage, profileStart_##stage)
+#else
+#define PROFILE_THREAD(name)
+#define PROFILE_BEGIN(stage)
+#define PROFILE_END(stage)
+#endif
+
+// Type definitions
+
+// Level streaming: a background thread reads the chunks around the camera into a fixed set of
+// slots. Slot s owns entries [s * CHUNK_MAX_*, (s + 1) * CHUNK_MAX_*) of the entity stores, and
+// only active slots are in the broadphase and get ticked, so memory and per-tick cost stay the
+// same however wide the level is
+#define MAX_RESIDENT_CHUNKS 8
+#define SIM_MARGIN 512           // chunks this far past either screen edge are simulated
+#define RESIDENT_MARGIN 1536     // and this far are kept loaded, ready to activate
+#define MAX_COINS (MAX_RESIDENT_CHUNKS * CHUNK_MAX_COINS)
+#define MAX_ENEMIES (MAX_RESIDENT_CHUNKS * CHUNK_MAX_ENEMIES)
+
+// Coins and enemies are stored as structure-of-arrays: one contiguous column per field,
+// sized for every slot, so the per-tick kernels stream through memory a SIMD register at a time
+#if defined(__AVX2__)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+
+typedef struct {
+    float x[MAX_COINS], y[MAX_COINS];
+    float w[MAX_COINS], h[MAX_COINS];
+    Uint8 collected[MAX_COINS];
+    Uint32 animStart[MAX_COINS];       // tick the spin started
+    int body[MAX_COINS];       // broadphase body id
+} CoinStore;
+
+typedef struct {
+    float x[MAX_ENEMIES], y[MAX_ENEMIES];
+    float w[MAX_ENEMIES], h[MAX_ENEMIES];
+    float vx[MAX_ENEMIES];             // pixels per reference tick, set by the enemy's state
+    float speed[MAX_ENEMIES];          // patrol speed from the level
+    float patrolStart[MAX_ENEMIES];    // Patrol boundary - start
+    float patrolEnd[MAX_ENEMIES];      // Patrol boundary - end
+    float spawnY[MAX_ENEMIES];         // flight height, fly-sine bobs around it
+    float prevX[MAX_ENEMIES], prevY[MAX_ENEMIES];   // Position at the previous tick, for interpolation
+    Uint32 animStart[MAX_ENEMIES];     // tick the clip started
+    Uint32 stateStart[MAX_ENEMIES];    // tick the current state was entered
+    Uint8 type[MAX_ENEMIES];           // LevelEnemyType
+    Uint8 state[MAX_ENEMIES];          // EnemyState
+    Uint8 facingRight[MAX_ENEMIES];    // the sheets face left, so facing right means drawing flipped
+    int body[MAX_ENEMIES];             // broadphase body id
+} EnemyStore;
+
+// Enemy behaviour is a state machine per type. Every tick each enemy gets exactly one event and
+// its type's brain gives the state that follows. The enemies are then bucketed by state and each
+// state's kernel sets velocities for its whole bucket in one loop, nothing switches per enemy.
+// The move and turn at the patrol bounds that follows is the same updateEnemies for every state
+typedef enum {
+    ENEMY_PATROL,              // back and forth between the patrol bounds at the level's speed
+    ENEMY_FLY_SINE,            // patrol, bobbing around the spawn height
+    ENEMY_CHASE,               // toward the player, stopping at the patrol bounds and ledges
+    ENEMY_SHOOT,               // stand facing the player, firing every fireInterval
+    ENEMY_DASH,                // charge at the player's side of the patrol range
+    ENEMY_STATE_COUNT
+} EnemyState;
+
+typedef enum {
+    ENEMY_SEES_PLAYER,         // within sightRange with no solid cell in between
+    ENEMY_LOST_PLAYER,
+    ENEMY_TIMED_OUT,           // has been in its state for the type's duration
+    ENEMY_EVENT_COUNT
+} EnemyEvent;
+
+// The state after each event in each state. Rows for states a brain never enters stay empty
+typedef struct {
+    EnemyState start;
+    Uint8 next[ENEMY_STATE_COUNT][ENEMY_EVENT_COUNT];
+} EnemyBrain;
+
+typedef struct {
+    const EnemyBrain *brain;
+    bool flies;                        // doesn't stop at ledges
+    float sightRange;                  // across, half that up and down. 0 never sees the player
+    float speed;                       // chasing and dashing, pixels per reference tick
+    float bobHeight;                   // fly-sine amplitude
+    int bobPeriod;                     // in reference ticks
+    int fireInterval;                  // reference ticks between shots
+    int duration[ENEMY_STATE_COUNT];   // reference ticks until ENEMY_TIMED_OUT, 0 for never
+} EnemyType;
+
+static const EnemyBrain walkerBrain = { ENEMY_PATROL, {
+    [ENEMY_PATROL] = { ENEMY_PATROL, ENEMY_PATROL, ENEMY_PATROL },
+} };
+
+static const EnemyBrain chaserBrain = { ENEMY_PATROL, {
+    [ENEMY_PATROL] = { ENEMY_CHASE, ENEMY_PATROL, ENEMY_PATROL },
+    [ENEMY_CHASE] = { ENEMY_CHASE, ENEMY_PATROL, ENEMY_CHASE },
+} };
+
+static const EnemyBrain dasherBrain = { ENEMY_PATROL, {
+    [ENEMY_PATROL] = { ENEMY_DASH, ENEMY_PATROL, ENEMY_PATROL },
+    [ENEMY_DASH] = { ENEMY_DASH, ENEMY_DASH, ENEMY_PATROL },
+} };
+
+static const EnemyBrain shooterBrain = { ENEMY_PATROL, {
+    [ENEMY_PATROL] = { ENEMY_SHOOT, ENEMY_PATROL, ENEMY_PATROL },
+    [ENEMY_SHOOT] = { ENEMY_SHOOT, ENEMY_PATROL, ENEMY_SHOOT },
+} };
+
+static const EnemyBrain flyerBrain = { ENEMY_FLY_SINE, {
+    [ENEMY_FLY_SINE] = { ENEMY_FLY_SINE, ENEMY_FLY_SINE, ENEMY_FLY_SINE },
+} };
+
+static const EnemyBrain flyingChaserBrain = { ENEMY_FLY_SINE, {
+    [ENEMY_FLY_SINE] = { ENEMY_CHASE, ENEMY_FLY_SINE, ENEMY_FLY_SINE },
+    [ENEMY_CHASE] = { ENEMY_CHASE, ENEMY_FLY_SINE, ENEMY_CHASE },
+} };
+
+static const EnemyBrain flyingShooterBrain = { ENEMY_FLY_SINE, {
+    [ENEMY_FLY_SINE] = { ENEMY_SHOOT, ENEMY_FLY_SINE, ENEMY_FLY_SINE },
+    [ENEMY_SHOOT] = { ENEMY_SHOOT, ENEMY_FLY_SINE, ENEMY_SHOOT },
+} };
+
+const EnemyType enemyTypes[LEVEL_ENEMY_TYPE_COUNT] = {
+    [LEVEL_ENEMY_ANGRYPIG] = { .brain = &chaserBrain, .sightRange = 200, .speed = 2.5f },
+    [LEVEL_ENEMY_BAT] = { .brain = &flyingChaserBrain, .flies = true, .sightRange = 180, .speed = 2.0f,
+                          .bobHeight = 10, .bobPeriod = 120 },
+    [LEVEL_ENEMY_BEE] = { .brain = &flyingShooterBrain, .flies = true, .sightRange = 220,
+                          .bobHeight = 8, .bobPeriod = 90, .fireInterval = 90 },
+    [LEVEL_ENEMY_BLUEBIRD] = { .brain = &flyerBrain, .flies = true, .bobHeight = 12, .bobPeriod = 120 },
+    [LEVEL_ENEMY_BUNNY] = { .brain = &chaserBrain, .sightRange = 200, .speed = 3.0f },
+    [LEVEL_ENEMY_CHAMELEON] = { .brain = &dasherBrain, .sightRange = 120, .speed = 4.0f,
+                                .duration = { [ENEMY_DASH] = 20 } },
+    [LEVEL_ENEMY_CHICKEN] = { .brain = &chaserBrain, .sightRange = 160, .speed = 3.5f },
+    [LEVEL_ENEMY_DUCK] = { .brain = &walkerBrain },
+    [LEVEL_ENEMY_FATBIRD] = { .brain = &flyerBrain, .flies = true, .bobHeight = 30, .bobPeriod = 180 },
+    [LEVEL_ENEMY_GHOST] = { .brain = &flyingChaserBrain, .flies = true, .sightRange = 250, .speed = 1.5f,
+                            .bobHeight = 6, .bobPeriod = 150 },
+    [LEVEL_ENEMY_MUSHROOM] = { .brain = &walkerBrain },
+    [LEVEL_ENEMY_PLANT] = { .brain = &shooterBrain, .sightRange = 300, .fireInterval = 100 },
+    [LEVEL_ENEMY_RADISH] = { .brain = &flyerBrain, .flies = true, .bobHeight = 6, .bobPeriod = 60 },
+    [LEVEL_ENEMY_RINO] = { .brain = &dasherBrain, .sightRange = 250, .speed = 6.0f,
+                           .duration = { [ENEMY_DASH] = 45 } },
+    [LEVEL_ENEMY_ROCKS] = { .brain = &walkerBrain },
+    [LEVEL_ENEMY_SKULL] = { .brain = &flyingChaserBrain, .flies = true, .sightRange = 200, .speed = 2.5f,
+                            .bobHeight = 8, .bobPeriod = 100 },
+    [LEVEL_ENEMY_SLIME] = { .brain = &walkerBrain },
+    [LEVEL_ENEMY_SNAIL] = { .brain = &walkerBrain },
+    [LEVEL_ENEMY_TRUNK] = { .brain = &shooterBrain, .sightRange = 250, .fireInterval = 80 },
+    [LEVEL_ENEMY_TURTLE] = { .brain = &walkerBrain },
 };
 
+// Shots fired by enemies. They fly straight until they hit solid terrain or the player or
+// time out, and belong to the world rather than a chunk
+#define MAX_BULLETS 64
+#define BULLET_SIZE 16
+#define BULLET_SPEED 4.0f              // pixels per reference tick
+#define BULLET_TICKS REFERENCE_TICKS(120)
+
+typedef struct {
+    float x[MAX_BULLETS], y[MAX_BULLETS];
+    float vx[MAX_BULLETS];
+    float prevX[MAX_BULLETS];
+    Uint32 expires[MAX_BULLETS];       // tick it's removed at
+    Uint8 type[MAX_BULLETS];           // enemy type that fired it, for the sprite
+    int count;
+} BulletStore;
+
+// Level data. The header, goal and chunk table are used in place from the mapped .lvl file
+typedef struct {
+    MappedFile file;
+    const void *data;
+    size_t size;
+    const LevelHeader *header;
+    const LevelRect *goal;
+    const LevelChunkTable *table;
+    const LevelChunk *chunks;
+    int chunkCount;
+} Level;
+
+Level level;
+
+// Terrain collision: the level cut into TILE_SIZE cells with one bit per cell in each layer,
+// every row packed into 64-bit words. Each world keeps the cells of its active chunks only, one
+// window of rows per slot, so the map costs the same however wide the level is. A query
+// touches only the words its cells are in
+#define TILE_SIZE LEVEL_TILE_SIZE
+#define MAX_STEP_UP 15.0f          // solid ground this far above the feet is climbed, not a wall
+
+typedef enum {
+    TILE_SOLID,                // ground and solid platforms
+    TILE_ONE_WAY,              // platforms that are only landed on from above
+    TILE_HAZARD,
+    TILE_LAYER_COUNT
+} TileLayer;
+
+#define TILE_MASK(layer) (1 << (layer))
+#define TILE_SURFACE (TILE_MASK(TILE_SOLID) | TILE_MASK(TILE_ONE_WAY))
+
+// A slot's window is every column a cell of its chunk touches. Chunks don't end on a cell
+// boundary, so the column they share is in both windows, each slot holding its own part
+#define CHUNK_TILE_COLUMNS (CHUNK_WIDTH / TILE_SIZE + 2)
+#define CHUNK_TILE_WORDS ((CHUNK_TILE_COLUMNS + 63) / 64)
+
+typedef struct {
+    int columns, rows;         // the level's size in cells
+    int chunk[MAX_RESIDENT_CHUNKS];    // chunk each slot's window holds, -1 while it's inactive
+    Uint64 *bits;              // [slot][layer][row][CHUNK_TILE_WORDS]
+} TileMap;
+
+typedef enum {
+    SLOT_FREE,
+    SLOT_QUEUED,                 // waiting for the streamer, the only state it touches
+    SLOT_LOADED,                 // payload read, not part of the world
+    SLOT_ACTIVE,
+} SlotState;
+
+typedef struct {
+    SDL_atomic_t state;          // SlotState
+    int chunk;                   // level chunk held
+    Uint8 payload[CHUNK_MAX_PAYLOAD];   // the chunk's bytes from the file
+    bool populated;              // its range of the stores holds live entities
+    int platformCount, coinCount, enemyCount;
+    Uint32 groundOffset;         // into payload, an offset so snapshots don't hold pointers
+    int overhangCount;
+    LevelPlatform overhangs[CHUNK_MAX_PLATFORMS];   // the chunk before's platforms reaching into this one
+} ChunkSlot;
+
+SDL_Thread *streamThread = NULL;
+SDL_mutex *streamLock = NULL;
+SDL_cond *streamWake = NULL;     // main thread -> streamer, there is work
+SDL_cond *streamLoaded = NULL;   // streamer -> main thread, a chunk arrived
+SDL_RWops *streamFile = NULL;    // the streamer's own handle on the level
+bool streamRunning = false;
+struct World *streamWorld = NULL;  // the one world the streamer fills
+
 typedef struct {
     float x, y;
     float w, h;
     float vx, vy;
     bool onGround;
     bool facingLeft;
-    int frame;
-    int frameDelay;
-    int frameTimer;
-    int totalFrames;
-    int frameWidth, frameHeight;
+    Uint32 animStart;          // tick the run clip started, kept at the current tick while standing
+    float prevX, prevY;
 } Player;
 
-SDL_Rect goal = { 1700, 420, 70, 90 };
+// Spatial hash broadphase: every collidable is a body filed under each world cell it touches
+#define GRID_CELL_SIZE 128
+#define MAX_QUERY_RESULTS 256
+
+typedef enum {
+    BODY_COIN     = 1 << 0,
+    BODY_ENEMY    = 1 << 1,
+} BodyType;
+
+typedef struct {
+    BodyType type;
+    int index;                 // into coins or enemies; next free body once removed
+    int minCellX, minCellY;    // cells currently covered
+    int maxCellX, maxCellY;
+    int queryStamp;            // last query that returned this body
+} Body;
+
+typedef struct {
+    int body;
+    int cellX, cellY;          // exact cell, buckets are shared by hash collisions
+    int next;                  // next entry in the bucket or free list, -1 ends
+} GridEntry;
+
+typedef struct {
+    Body *bodies;
+    int bodyCount;
+    int bodyFree;              // removed bodies, reused before growing, -1 when none
+    int bodyCapacity;
+    GridEntry *entries;
+    int entryCapacity;
+    int freeEntry;
+    int *buckets;
+    int bucketMask;
+    int queryStamp;
+} Grid;
+
+// Where a world is between lives. Dying and Won hold it still under a message for
+// MESSAGE_TICKS, then Resetting puts the level back on the next tick
+typedef enum {
+    GAME_PLAYING,
+    GAME_DYING,
+    GAME_WON,
+    GAME_RESETTING
+} GameState;
+
+#define MESSAGE_TICKS TICK_RATE
+
+// Rewind history: a snapshot of the world every REWIND_INTERVAL ticks, the oldest overwritten
+#define REWIND_SNAPSHOTS 10
+#define REWIND_INTERVAL TICK_RATE
+
+typedef struct {
+    int count;
+    int newest;
+    Uint32 ticks[REWIND_SNAPSHOTS];    // world tick each was taken at
+    Uint8 *data;                       // REWIND_SNAPSHOTS * snapshotSize() bytes
+} RewindRing;
+
+// Everything one running game owns. The level file is shared by every world, read-only, so
+// several can be simulated side by side. The world is a single block sized by worldSize, and
+// everything from savedAt to the end of it is game state with no pointers into the block, so a
+// snapshot is one memcpy of that range
+typedef struct World {
+    // Not in snapshots: what the world is and what it has done so far
+    bool streamed;             // chunks come from the streaming thread, not straight from the mapping
+    int wins, deaths;          // since the world was created
+    int coinsTaken;            // since the world was created, score goes back to 0 on a reset
+    Uint32 tick;               // ticks played, the clock every animation runs on
+    Uint8 lastInput;           // last tick's input, so holding rewind only rewinds once
+    RewindRing *rewind;        // NULL when the world keeps no history
+    Grid grid;                 // rebuilt from the active chunks after a restore
+    TileMap tiles;             // so are the terrain cells
+
+    Uint32 savedAt;            // tick the state was saved at, the tick stamps below count from it
+    Player player;
+    SDL_Rect camera;
+    int score;
+    GameState state;
+    int stateTicks;            // ticks left in Dying or Won
+    const char *message;       // shown over the scene while not playing
+    SDL_Color messageColor;
+    CoinStore coins;
+    EnemyStore enemies;
+    BulletStore bullets;
+    ChunkSlot slots[MAX_RESIDENT_CHUNKS];
+    int activeSlots[MAX_RESIDENT_CHUNKS];
+    int activeSlotCount;
+    LevelPlatform platforms[MAX_RESIDENT_CHUNKS * CHUNK_MAX_PLATFORMS];
+    Uint8 coinCollected[];     // one bit per coin in the level, survives chunks being evicted
+} World;
+
+#define SNAPSHOT_START offsetof(World, savedAt)
+
+// The world as the level starts, taken by the first reset and restored by every one after
+Uint8 *levelStart = NULL;
+
+// What the main thread needs to draw one tick, copied out of the world by the sim thread so
+// drawing never reads state that's being simulated. Frames come from tick and the animStarts
+typedef struct {
+    float x, y, prevX, prevY;
+    float w, h;
+    Uint32 animStart;
+    bool flip;
+    Uint8 type;                // enemies and bullets: the LevelEnemyType
+} SnapshotSprite;
+
+typedef struct {
+    Uint64 tickCounter;        // performance counter when the tick was due, for interpolation
+    Uint32 tick;
+    Player player;
+    int score;
+    GameState state;
+    const char *message;
+    SDL_Color messageColor;
+    int groundCount;
+    int groundChunk[MAX_RESIDENT_CHUNKS];
+    Uint8 ground[MAX_RESIDENT_CHUNKS][CHUNK_WIDTH / GROUND_TILE_SIZE];
+    int platformCount, coinCount, enemyCount, bulletCount;
+    LevelPlatform platforms[MAX_RESIDENT_CHUNKS * CHUNK_MAX_PLATFORMS];
+    SnapshotSprite coins[MAX_COINS];
+    SnapshotSprite enemies[MAX_ENEMIES];
+    SnapshotSprite bullets[MAX_BULLETS];
+} RenderSnapshot;
+
+// Windowed, the world ticks on its own thread while the main thread handles events and
+// draws. Snapshots go through a triple buffer: the sim thread fills its back buffer and
+// swaps it into the middle, the main thread swaps the middle for its front buffer when
+// something newer is there. Each swap is one atomic exchange, neither side ever waits
+#define SNAPSHOT_FRESH 4           // set in snapshotMiddle until the main thread takes it
+
+RenderSnapshot snapshots[3];
+SDL_atomic_t snapshotMiddle;       // buffer index, | SNAPSHOT_FRESH when newly published
+int simBuffer = 0;                 // only touched by the sim thread
+int drawBuffer = 1;                // only touched by the main thread
+SDL_Thread *simThread = NULL;
+SDL_atomic_t simRunning;
+SDL_atomic_t simFinished;          // the input ran out, a replay ended
+SDL_atomic_t liveInput;            // keyboard bits, sampled by the main thread every frame
+
+// Render queue: every sprite that moves or animates is pushed as a command keyed by its layer
+// and atlas page. Commands that miss the window are dropped as they're pushed, the rest are
+// radix sorted on the key so each page is drawn in one run per layer, whatever the level size.
+// Within a layer and page commands keep the order they were pushed in, later ones on top
+#define MAX_RENDER_COMMANDS (2 + MAX_COINS + MAX_ENEMIES + MAX_BULLETS)
+
+typedef enum {
+    LAYER_SCENERY,
+    LAYER_PICKUPS,
+    LAYER_ENEMIES,
+    LAYER_BULLETS,
+    LAYER_PLAYER
+} RenderLayer;
+
+typedef struct {
+    Uint16 key;                // layer << 8 | atlas page
+    bool flip;
+    const Sprite *sprite;
+    SDL_Rect src;              // empty for the whole sprite
+    SDL_Rect dst;              // on screen
+} RenderCommand;
+
+typedef struct {
+    RenderCommand *commands;
+    int count;
+    int capacity;
+    SDL_Rect bounds;           // commands outside are culled
+} RenderQueue;
+
+// Damage tracking for the software renderer, where filling the whole window every frame is
+// the cost. The scene is kept in sceneTexture between frames and only the rectangles where a
+// sprite or the HUD changed are redrawn, over staticTexture's cached background and terrain.
+// When the camera scrolls the static layer is rebuilt and the whole scene redrawn
+#define MAX_DAMAGE_RECTS 32
+
+bool damageTracking = false;   // software renderer that can draw into textures
+SDL_Texture *staticTexture = NULL;
+SDL_Texture *sceneTexture = NULL;
+Uint32 staticKey = 0;          // camera, resident chunks and uploaded sheets staticTexture shows
+bool sceneValid = false;       // false redraws everything next frame
+RenderCommand sceneCommands[2][MAX_RENDER_COMMANDS];   // sorted queues of this frame and the last
+int sceneCommandCount[2];
+int sceneFrame = 0;            // which sceneCommands list is this frame's
+SDL_Rect damageRects[MAX_DAMAGE_RECTS];
+int damageRectCount = 0;
+bool damageFull = false;
+
+// The ground and platform tiles never move, so they're composited into STRIP_WIDTH wide render
+// targets, level height, as strips come into view, and a frame blits the one or two on screen.
+// A strip is baked from the chunks resident at the time and baked again once a chunk it overlaps
+// streams in, or after invalidateTerrain when its tiles change
+#define STRIP_WIDTH 512
+#define MAX_TERRAIN_STRIPS 4       // the window spans at most 3 strips
+
+typedef struct {
+    SDL_Texture *texture;
+    int index;                 // strip x / STRIP_WIDTH, -1 when it holds nothing
+    Uint32 key;                // which overlapping chunks it was baked with
+    bool valid;
+    Uint32 lastUsed;           // frame it was last drawn, the oldest is reused
+} TerrainStrip;
+
+TerrainStrip terrainStrips[MAX_TERRAIN_STRIPS];
+bool terrainStripsFailed = false;  // no render targets, tiles are drawn one by one
+SDL_BlendMode terrainBlendMode;    // strips hold premultiplied alpha where the renderer can
+Uint32 terrainFrame = 0;
+
 
 // Function prototypes
-void resetGame(Player* player);
+void resetGame(World* w);
+bool mapFile(const char* path, MappedFile* file);
+void unmapFile(MappedFile* file);
+bool loadLevel(const char* path);
+void unloadLevel();
+bool initTileMap(TileMap* map);
+void freeTileMap(TileMap* map);
+void clearSlotTiles(TileMap* map, int slot, int chunk);
+void fillTiles(TileMap* map, int slot, TileLayer layer, int x, int y, int w, int h);
+void buildSlotTiles(World* w, ChunkSlot* slot);
+bool tilesAny(const TileMap* map, int layers, int column0, int column1, int row0, int row1);
+float groundProbe(const TileMap* map, float x, float w, float y, float maxDistance);
+bool raycastTiles(const TileMap* map, float x0, float y0, float x1, float y1, int layers, float* hitX, float* hitY);
+bool initStreaming(World* w, const char* path);
+void stopStreaming();
+void updateStreaming(World* w);
+void spawnChunk(World* w, ChunkSlot* slot);
 bool initSDL();
-bool loadMedia();
+bool loadMedia(AssetProgressFn progress);
 void cleanupSDL();
-void handleInput(Player* player, bool* running);
-void updatePhysics(Player* player);
-void checkCollisions(Player* player);
-void checkEnemyCollisions(Player* player);
-void checkGoalCollision(Player* player);
-void checkFallDetection(Player* player);
-void updateCamera(Player player);
-void renderScene(Player player);
-void displayMessage(const char* message, SDL_Color color);
-SDL_Texture* loadTexture(const char* path);
-
-// Reset the game
-void resetGame(Player* player) {
-    player->x = START_X;
-    player->y = START_Y;
+void handleEvents(bool* running);
+void handleInput(Player* player, Uint8 input);
+void savePreviousPositions(World* w);
+void updatePhysics(World* w);
+size_t worldSize();
+size_t snapshotSize();
+bool initWorld(World* w);
+void freeWorld(World* w);
+void saveWorld(World* w, void* snapshot);
+void restoreWorld(World* w, const void* snapshot);
+bool initRewind(World* w);
+void pushRewind(World* w);
+bool rewindWorld(World* w);
+void updateEnemyStates(World* w);
+void updateEnemies(EnemyStore* e, int first, int count);
+void fireBullet(World* w, int type, float x, float y, float vx);
+void updateBullets(World* w);
+void initClips();
+SDL_Rect clipFrame(const AnimClip* clip, Uint32 tick, Uint32 start);
+bool initGrid(Grid* g, int expectedBodies);
+void clearGrid(Grid* g);
+void freeGrid(Grid* g);
+int addBody(Grid* g, BodyType type, int index, float x, float y, float w, float h);
+void moveBody(Grid* g, int body, float x, float y, float w, float h);
+void removeBody(Grid* g, int body);
+int queryGrid(Grid* g, float x, float y, float w, float h, int typeMask, int* results, int maxResults);
+void syncEnemyBodies(World* w);
+void checkEnemyEnemyCollisions(World* w);
+void movePlayer(const TileMap* map, Player* player, float dx, float dy);
+void checkTerrainCollisions(World* w);
+void checkCollisions(World* w);
+void checkEnemyCollisions(World* w);
+void checkBulletCollisions(World* w);
+void checkGoalCollision(World* w);
+void checkFallDetection(World* w);
+void endLife(World* w, GameState state, const char* message, SDL_Color color);
+void updateGameState(World* w);
+Uint32 hashBytes(Uint32 hash, const void* data, size_t size);
+Uint32 hashState(const World* w);
+Uint8 sampleInput();
+void startRecording(const char* path);
+void recordTick(Uint8 input, Uint32 hash);
+bool saveRecording();
+bool loadReplay(const char* path);
+bool nextInput(Uint8* input);
+void finishTick(Uint8 input, const World* w);
+void stopReplay();
+Uint8 randomInput();
+void runHeadless(World* w);
+bool loadSpriteSizes(SpriteSheet* sheets, int count);
+void simulateTick(World* w, Uint8 input);
+void updateCamera(SDL_Rect* camera, const Player* player);
+void takeSnapshot(const World* w, RenderSnapshot* s);
+void publishSnapshot();
+const RenderSnapshot* latestSnapshot();
+bool startSimulation(World* w);
+void stopSimulation();
+void renderScene(const RenderSnapshot* s, float alpha);
+bool initDamageTracking();
+void pushSprite(RenderQueue* queue, RenderLayer layer, const Sprite* sprite, SDL_Rect src, SDL_Rect dst, bool flip);
+int sortRenderQueue(const RenderQueue* queue, RenderCommand* sorted);
+void queueScene(const RenderSnapshot* s, float alpha, const SDL_Rect* camera, RenderQueue* queue);
+void drawStaticLayer(const RenderSnapshot* s, const SDL_Rect* camera);
+void drawTerrainTiles(const RenderSnapshot* s, const SDL_Rect* camera, int fromX, int toX);
+TerrainStrip* terrainStrip(const RenderSnapshot* s, int index);
+void invalidateTerrain(int x, int w);
+void freeTerrainStrips();
+void drawRenderCommands(const RenderCommand* commands, int count, const SDL_Rect* clip);
+SDL_Rect labelBounds(const TextLabel* label);
+void addDamage(SDL_Rect rect);
+void renderDamagedScene(const RenderSnapshot* s, const SDL_Rect* camera, const RenderCommand* commands, int count);
+void drawMessage(const RenderSnapshot* s);
+SDL_Surface* loadSurface(const char* path);
+bool packSheet(SDL_Surface* sheet, Sprite* sprite, const char* path);
+bool openAssetArchive(const char* path);
+void closeAssetArchive();
+const AssetEntry* findAsset(const char* name);
+SDL_Surface* archiveSurface(const AssetEntry* entry);
+bool startAssetLoading(SpriteSheet* sheets, int count);
+bool waitForCriticalAssets(AssetProgressFn progress);
+void pumpAssets();
+void stopAssetLoading();
+void drawLoadingProgress(int loaded, int total);
+double millisecondsSinceStartup();
+void* arenaAlloc(Arena* arena, size_t size);
+char* arenaPrintf(Arena* arena, const char* format, ...);
+void resetArena(Arena* arena);
+void freeArena(Arena* arena);
+void initBatch();
+void flushBatch();
+void drawQuad(AtlasPage* page, SDL_Rect region, float x, float y, float w, float h, bool flip, SDL_Color color);
+void drawSprite(const Sprite* sprite, const SDL_Rect* src, float x, float y, float w, float h, bool flip);
+void drawTintedSprite(const Sprite* sprite, const SDL_Rect* src, float x, float y, float w, float h, bool flip, SDL_Color color);
+bool loadBakedFonts(const char* path);
+GlyphFont* findGlyphFont(int size);
+int measureText(const GlyphFont* font, const char* text);
+void setLabel(TextLabel* label, GlyphFont* font, const char* text, int x, int y, SDL_Color color);
+void drawLabel(const TextLabel* label);
+#ifdef PROFILE
+void profileRegisterThread(const char* name);
+void profileRecord(const char* name, Uint64 start);
+void profileEndFrame(Uint64 frameStart);
+void startProfileCapture();
+bool writeProfileTrace(const char* path);
+void drawProfileOverlay();
+void stopProfiler();
+#endif
+
+// Reset the game. The first reset builds the level start from the level file, every later one
+// (in any world) just restores it
+void resetGame(World* w) {
+    if (levelStart) {
+        restoreWorld(w, levelStart);
+        return;
+    }
+
+    Player* player = &w->player;
+
+    player->x = level.header->startX;
+    player->y = level.header->startY;
     player->vx = 0;
     player->vy = 0;
     player->onGround = false;
     player->facingLeft = false;
-    player->frame = 0;
-    player->frameDelay = 6;
-    player->frameTimer = 0;
-    player->totalFrames = 12;
-    player->frameWidth = 32;
-    player->frameHeight = 32;
+    player->animStart = w->tick;
     player->w = 50;
     player->h = 50;
 
-    score = 0;
+    w->score = 0;
+    w->state = GAME_PLAYING;
+    w->stateTicks = 0;
+    w->message = NULL;
 
-    for (int i = 0; i < MAX_COINS; i++) {
-        coins[i].collected = false;
-        coins[i].frame = 0;
-        coins[i].frameTimer = 0;
-        coins[i].frameDelay = 8;
-        coins[i].totalFrames = 6;
-        coins[i].frameWidth = 32;
-        coins[i].frameHeight = 32;
+    // Coins come back and enemies go back to their spawn. Resident chunks that aren't
+    // active are respawned when they next activate
+    memset(w->coinCollected, 0, (level.table->coinCount + 7) / 8 + 1);
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        if (SDL_AtomicGet(&w->slots[s].state) == SLOT_ACTIVE) {
+            spawnChunk(w, &w->slots[s]);
+        } else {
+            w->slots[s].populated = false;
+        }
     }
+    syncEnemyBodies(w);
+
+    // Bring in the world around the spawn point before the next tick
+    updateCamera(&w->camera, player);
+    updateStreaming(w);
 
-    // Reset enemies to original positions with animation properties
-    enemies[0] = (Enemy){600, 420, 40, 40, 1.0f, false, 0, 0, 6, 9, 500, 700};
-    enemies[1] = (Enemy){900, 420, 40, 40, -1.0f, true, 0, 0, 6, 9, 800, 1000};
-    enemies[2] = (Enemy){1300, 420, 40, 40, 0.8f, false, 0, 0, 6, 9, 1200, 1400};
+    // Nothing to interpolate from after a reset
+    savePreviousPositions(w);
+
+    levelStart = malloc(snapshotSize());
+    if (levelStart) saveWorld(w, levelStart);
 }
 
-// Load a texture from file
-SDL_Texture* loadTexture(const char* path) {
-    SDL_Texture* newTexture = NULL;
-    
-    // Load image at specified path
-    SDL_Surface* loadedSurface = IMG_Load(path);
-    if (loadedSurface == NULL) {
-        printf("Unable to load image %s! SDL_image Error: %s\n", path, IMG_GetError());
-        return NULL;
+// Map a whole file read-only
+bool mapFile(const char* path, MappedFile* file) {
+    memset(file, 0, sizeof(*file));
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
     }
-    
-    // Create texture from surface pixels
-    newTexture = SDL_CreateTextureFromSurface(renderer, loadedSurface);
-    if (newTexture == NULL) {
-        printf("Unable to create texture from %s! SDL Error: %s\n", path, SDL_GetError());
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        close(fd);
+        return false;
     }
-    
-    // Get rid of old loaded surface
-    SDL_FreeSurface(loadedSurface);
-    
-    return newTexture;
+
+    file->size = info.st_size;
+    file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file->data == MAP_FAILED) {
+        file->data = NULL;
+        return false;
+    }
+#else
+    // No mmap here, read it in one go and use the buffer the same way
+    file->data = SDL_LoadFile(path, &file->size);
+    if (!file->data) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+void unmapFile(MappedFile* file) {
+#ifndef _WIN32
+    if (file->data) munmap(file->data, file->size);
+#else
+    SDL_free(file->data);
+#endif
+    memset(file, 0, sizeof(*file));
+}
+
+// Map a .lvl file and point the level at its goal and chunk table. Chunk payloads are left
+// for the streaming thread to read, so they never become resident through the mapping
+bool loadLevel(const char* path) {
+    memset(&level, 0, sizeof(level));
+
+    if (!mapFile(path, &level.file)) {
+        printf("Unable to open level %s!\n", path);
+        return false;
+    }
+    level.data = level.file.data;
+    level.size = level.file.size;
+
+    const Uint8* base = level.data;
+    const LevelHeader* header = level.data;
+    const LevelSection* sections = (const LevelSection*)(base + sizeof(LevelHeader));
+
+    if (level.size < sizeof(LevelHeader) || header->magic != LEVEL_MAGIC || header->version != LEVEL_VERSION ||
+        sizeof(LevelHeader) + (Uint64)header->sectionCount * sizeof(LevelSection) > level.size) {
+        printf("%s is not a version %d level!\n", path, LEVEL_VERSION);
+        unloadLevel();
+        return false;
+    }
+    level.header = header;
+
+    for (Uint32 s = 0; s < header->sectionCount; s++) {
+        const LevelSection* section = &sections[s];
+        if (section->offset % LEVEL_ALIGN != 0 || section->offset > level.size ||
+            section->size > level.size - section->offset) {
+            printf("Level %s has a bad section table!\n", path);
+            unloadLevel();
+            return false;
+        }
+
+        const Uint8* payload = base + section->offset;
+        Uint64 expected = 0;
+
+        switch (section->type) {
+        case LEVEL_SECTION_GOAL:
+            level.goal = (const LevelRect*)payload;
+            expected = sizeof(LevelRect);
+            break;
+        case LEVEL_SECTION_CHUNKS:
+            level.table = (const LevelChunkTable*)payload;
+            level.chunks = (const LevelChunk*)(payload + sizeof(LevelChunkTable));
+            level.chunkCount = section->count;
+            expected = sizeof(LevelChunkTable) + (Uint64)section->count * sizeof(LevelChunk);
+            break;
+        default:
+            // Unknown sections are skipped so older builds can read newer files
+            expected = section->size;
+            break;
+        }
+
+        if (section->size < expected) {
+            printf("Level %s has a truncated section!\n", path);
+            unloadLevel();
+            return false;
+        }
+    }
+
+    if (!level.goal || !level.table || level.chunkCount == 0) {
+        printf("Level %s is missing its goal or chunks!\n", path);
+        unloadLevel();
+        return false;
+    }
+
+    // Slots are sized for the compiled-in chunk limits, so the file has to agree with them
+    if (level.table->chunkWidth != CHUNK_WIDTH || level.table->groundTileSize != GROUND_TILE_SIZE) {
+        printf("Level %s was built with different chunk settings!\n", path);
+        unloadLevel();
+        return false;
+    }
+
+    for (int c = 0; c < level.chunkCount; c++) {
+        const LevelChunk* chunk = &level.chunks[c];
+        LevelChunkLayout layout = levelChunkLayout(chunk->platformCount, chunk->coinCount,
+                                                   chunk->enemyCount, chunk->groundColumns);
+        if (chunk->platformCount > CHUNK_MAX_PLATFORMS || chunk->coinCount > CHUNK_MAX_COINS ||
+            chunk->enemyCount > CHUNK_MAX_ENEMIES || chunk->groundColumns != CHUNK_WIDTH / GROUND_TILE_SIZE ||
+            chunk->size < layout.size || chunk->size > CHUNK_MAX_PAYLOAD ||
+            chunk->offset > level.size || chunk->size > level.size - chunk->offset) {
+            printf("Level %s has a bad chunk %d!\n", path, c);
+            unloadLevel();
+            return false;
+        }
+    }
+
+    SDL_Log("Loaded level %s: %d px wide, %d chunks, %u coins",
+            path, header->width, level.chunkCount, level.table->coinCount);
+    return true;
+}
+
+void unloadLevel() {
+    free(levelStart);
+    levelStart = NULL;
+    unmapFile(&level.file);
+    memset(&level, 0, sizeof(level));
+}
+
+// Chunk under a world x, clamped to the level
+static int chunkAt(float x) {
+    int c = (int)SDL_floorf(x / CHUNK_WIDTH);
+    if (c < 0) c = 0;
+    if (c >= level.chunkCount) c = level.chunkCount - 1;
+    return c;
+}
+
+// The slot holding a chunk, or NULL when it isn't resident
+static ChunkSlot* findSlot(World* w, int chunk) {
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        if (w->slots[s].chunk == chunk && SDL_AtomicGet(&w->slots[s].state) != SLOT_FREE) return &w->slots[s];
+    }
+    return NULL;
+}
+
+// A slot's window, [layer][row][CHUNK_TILE_WORDS]
+static Uint64* slotTiles(const TileMap* map, int slot) {
+    return map->bits + (size_t)slot * TILE_LAYER_COUNT * map->rows * CHUNK_TILE_WORDS;
+}
+
+// Column of the level the first column of a chunk's window is
+static int chunkFirstColumn(int chunk) {
+    return chunk * CHUNK_WIDTH / TILE_SIZE;
+}
+
+// A window for every slot, as tall as the level. Its size depends on the level's height alone
+bool initTileMap(TileMap* map) {
+    map->columns = (level.header->width + TILE_SIZE - 1) / TILE_SIZE;
+    map->rows = (level.header->height + TILE_SIZE - 1) / TILE_SIZE;
+    map->bits = calloc((size_t)MAX_RESIDENT_CHUNKS * TILE_LAYER_COUNT * map->rows * CHUNK_TILE_WORDS, sizeof(Uint64));
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) map->chunk[s] = -1;
+    return map->bits != NULL;
+}
+
+void freeTileMap(TileMap* map) {
+    free(map->bits);
+    map->bits = NULL;
+}
+
+// Hand a slot's window to a chunk, empty, or take it away with chunk -1
+void clearSlotTiles(TileMap* map, int slot, int chunk) {
+    map->chunk[slot] = chunk;
+    memset(slotTiles(map, slot), 0, (size_t)TILE_LAYER_COUNT * map->rows * CHUNK_TILE_WORDS * sizeof(Uint64));
+}
+
+// Set every cell a pixel rect touches in one layer of a slot's window, the rect clipped to the
+// slot's chunk so a cell on the boundary only gets the part on this side
+void fillTiles(TileMap* map, int slot, TileLayer layer, int x, int y, int w, int h) {
+    int chunk = map->chunk[slot];
+    int left = SDL_max(x, chunk * CHUNK_WIDTH);
+    int right = SDL_min(x + w, (chunk + 1) * CHUNK_WIDTH);
+    if (left >= right) return;
+
+    int first = chunkFirstColumn(chunk);
+    int column0 = left / TILE_SIZE - first;
+    int column1 = (right + TILE_SIZE - 1) / TILE_SIZE - 1 - first;
+    int row0 = SDL_max(y / TILE_SIZE, 0);
+    int row1 = SDL_min((y + h + TILE_SIZE - 1) / TILE_SIZE, map->rows) - 1;
+
+    Uint64* bits = slotTiles(map, slot) + (size_t)layer * map->rows * CHUNK_TILE_WORDS;
+    for (int row = row0; row <= row1; row++) {
+        for (int c = column0; c <= column1; c++) bits[row * CHUNK_TILE_WORDS + c / 64] |= 1ull << (c % 64);
+    }
+}
+
+// tilesAny within one slot's window, columns relative to it
+static bool slotTilesAny(const TileMap* map, int slot, int layers, int column0, int column1, int row0, int row1) {
+    int word0 = column0 / 64, word1 = column1 / 64;
+    Uint64 mask0 = ~0ull << (column0 % 64);
+    Uint64 mask1 = ~0ull >> (63 - column1 % 64);
+    const Uint64* window = slotTiles(map, slot);
+
+    for (int layer = 0; layer < TILE_LAYER_COUNT; layer++) {
+        if (!(layers & TILE_MASK(layer))) continue;
+
+        for (int row = row0; row <= row1; row++) {
+            const Uint64* bits = window + ((size_t)layer * map->rows + row) * CHUNK_TILE_WORDS;
+            if (word0 == word1) {
+                if (bits[word0] & mask0 & mask1) return true;
+                continue;
+            }
+            if (bits[word0] & mask0) return true;
+            for (int word = word0 + 1; word < word1; word++) {
+                if (bits[word]) return true;
+            }
+            if (bits[word1] & mask1) return true;
+        }
+    }
+    return false;
+}
+
+// Whether any cell in the inclusive column and row ranges is set in one of the layers. Only
+// active chunks have cells set, a column two chunks share is looked up in both their windows
+bool tilesAny(const TileMap* map, int layers, int column0, int column1, int row0, int row1) {
+    column0 = SDL_max(column0, 0);
+    column1 = SDL_min(column1, map->columns - 1);
+    row0 = SDL_max(row0, 0);
+    row1 = SDL_min(row1, map->rows - 1);
+    if (column0 > column1 || row0 > row1) return false;
+
+    int chunk0 = column0 * TILE_SIZE / CHUNK_WIDTH;
+    int chunk1 = ((column1 + 1) * TILE_SIZE - 1) / CHUNK_WIDTH;
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        int chunk = map->chunk[s];
+        if (chunk < chunk0 || chunk > chunk1) continue;
+
+        int first = chunkFirstColumn(chunk);
+        int local0 = SDL_max(column0 - first, 0);
+        int local1 = SDL_min(column1 - first, CHUNK_TILE_COLUMNS - 1);
+        if (local0 <= local1 && slotTilesAny(map, s, layers, local0, local1, row0, row1)) return true;
+    }
+    return false;
+}
+
+// Cells under a span of x to x + w, the right edge exclusive like the collision tests
+static void tileColumns(float x, float w, int* column0, int* column1) {
+    *column0 = (int)SDL_floorf(x / TILE_SIZE);
+    *column1 = (int)SDL_ceilf((x + w) / TILE_SIZE) - 1;
+}
+
+// How far below y the first surface under x to x + w starts, or maxDistance if there's none
+// that close. Walks down a row at a time
+float groundProbe(const TileMap* map, float x, float w, float y, float maxDistance) {
+    int column0, column1;
+    tileColumns(x, w, &column0, &column1);
+
+    int first = (int)SDL_floorf(y / TILE_SIZE);
+    int last = (int)SDL_floorf((y + maxDistance) / TILE_SIZE);
+    for (int row = first; row <= last; row++) {
+        if (tilesAny(map, TILE_SURFACE, column0, column1, row, row)) {
+            return SDL_max(row * TILE_SIZE - y, 0.0f);
+        }
+    }
+    return maxDistance;
+}
+
+// Steps cell by cell along the segment (Amanatides and Woo) and stops at the first set cell,
+// where the segment enters it. False if it reaches x1, y1 without hitting one
+bool raycastTiles(const TileMap* map, float x0, float y0, float x1, float y1, int layers, float* hitX, float* hitY) {
+    int column = (int)SDL_floorf(x0 / TILE_SIZE);
+    int row = (int)SDL_floorf(y0 / TILE_SIZE);
+    int endColumn = (int)SDL_floorf(x1 / TILE_SIZE);
+    int endRow = (int)SDL_floorf(y1 / TILE_SIZE);
+    float dx = x1 - x0, dy = y1 - y0;
+
+    int stepX = dx > 0 ? 1 : -1;
+    int stepY = dy > 0 ? 1 : -1;
+    float deltaX = dx != 0 ? SDL_fabsf(TILE_SIZE / dx) : 1e30f;
+    float deltaY = dy != 0 ? SDL_fabsf(TILE_SIZE / dy) : 1e30f;
+    float nextX = dx != 0 ? ((column + (dx > 0)) * TILE_SIZE - x0) / dx : 1e30f;
+    float nextY = dy != 0 ? ((row + (dy > 0)) * TILE_SIZE - y0) / dy : 1e30f;
+    float t = 0.0f;
+
+    for (;;) {
+        if (tilesAny(map, layers, column, column, row, row)) {
+            if (hitX) *hitX = x0 + dx * t;
+            if (hitY) *hitY = y0 + dy * t;
+            return true;
+        }
+        if (column == endColumn && row == endRow) return false;
+
+        if (nextX < nextY) {
+            t = nextX;
+            nextX += deltaX;
+            column += stepX;
+        } else {
+            t = nextY;
+            nextY += deltaY;
+            row += stepY;
+        }
+        if (t > 1.0f) return false;
+    }
+}
+
+// The slot's overhangs hold the chunk before's count platforms, keep the ones that reach into
+// the slot's chunk. levelc makes sure none reach any further
+static void keepOverhangs(ChunkSlot* slot, int count) {
+    slot->overhangCount = 0;
+    for (int i = 0; i < count; i++) {
+        const LevelPlatform* p = &slot->overhangs[i];
+        if (p->x + p->w > slot->chunk * CHUNK_WIDTH) slot->overhangs[slot->overhangCount++] = *p;
+    }
+}
+
+// Runs on its own thread: read queued chunks into their slots, nothing else is touched here
+static int streamChunks(void* data) {
+    (void)data;
+    PROFILE_THREAD("stream");
+
+    SDL_LockMutex(streamLock);
+    while (streamRunning) {
+        ChunkSlot* job = NULL;
+        for (int s = 0; s < MAX_RESIDENT_CHUNKS && !job; s++) {
+            if (SDL_AtomicGet(&streamWorld->slots[s].state) == SLOT_QUEUED) job = &streamWorld->slots[s];
+        }
+        if (!job) {
+            SDL_CondWait(streamWake, streamLock);
+            continue;
+        }
+        SDL_UnlockMutex(streamLock);
+
+        PROFILE_BEGIN(loadChunk);
+        const LevelChunk* info = &level.chunks[job->chunk];
+        if (SDL_RWseek(streamFile, info->offset, RW_SEEK_SET) < 0 ||
+            SDL_RWread(streamFile, job->payload, info->size, 1) != 1) {
+            // An empty chunk is better than stalling the game on it
+            printf("Unable to read chunk %d! SDL Error: %s\n", job->chunk, SDL_GetError());
+            memset(job->payload, 0, CHUNK_MAX_PAYLOAD);
+        }
+
+        // Platforms come first in a payload, only the chunk before's are needed
+        int count = job->chunk > 0 ? level.chunks[job->chunk - 1].platformCount : 0;
+        if (count > 0 && (SDL_RWseek(streamFile, level.chunks[job->chunk - 1].offset, RW_SEEK_SET) < 0 ||
+                          SDL_RWread(streamFile, job->overhangs, count * sizeof(LevelPlatform), 1) != 1)) {
+            printf("Unable to read the platforms before chunk %d! SDL Error: %s\n", job->chunk, SDL_GetError());
+            count = 0;
+        }
+        keepOverhangs(job, count);
+        PROFILE_END(loadChunk);
+
+        SDL_LockMutex(streamLock);
+        SDL_AtomicSet(&job->state, SLOT_LOADED);
+        SDL_CondBroadcast(streamLoaded);
+    }
+    SDL_UnlockMutex(streamLock);
+    return 0;
+}
+
+// Hand a world's chunk loading to the streaming thread. Worlds that aren't streamed copy
+// their chunks straight out of the mapped level when they queue them
+bool initStreaming(World* w, const char* path) {
+    w->streamed = true;
+    streamWorld = w;
+
+    streamFile = SDL_RWFromFile(path, "rb");
+    if (!streamFile) {
+        printf("Unable to open level %s! SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    streamLock = SDL_CreateMutex();
+    streamWake = SDL_CreateCond();
+    streamLoaded = SDL_CreateCond();
+    streamRunning = true;
+    streamThread = SDL_CreateThread(streamChunks, "chunk streamer", NULL);
+    if (!streamLock || !streamWake || !streamLoaded || !streamThread) {
+        printf("Unable to start the chunk streamer! SDL Error: %s\n", SDL_GetError());
+        streamRunning = false;
+        return false;
+    }
+    return true;
+}
+
+void stopStreaming() {
+    if (streamThread) {
+        SDL_LockMutex(streamLock);
+        streamRunning = false;
+        SDL_CondSignal(streamWake);
+        SDL_UnlockMutex(streamLock);
+        SDL_WaitThread(streamThread, NULL);
+        streamThread = NULL;
+    }
+
+    if (streamLoaded) SDL_DestroyCond(streamLoaded);
+    if (streamWake) SDL_DestroyCond(streamWake);
+    if (streamLock) SDL_DestroyMutex(streamLock);
+    if (streamFile) SDL_RWclose(streamFile);
+    streamLoaded = streamWake = NULL;
+    streamLock = NULL;
+    streamFile = NULL;
+
+    if (streamWorld) streamWorld->streamed = false;
+    streamWorld = NULL;
+}
+
+// Put a chunk's coins and enemies into its slot's range of the stores at their spawn state
+void spawnChunk(World* w, ChunkSlot* slot) {
+    int s = slot - w->slots;
+    const LevelChunk* info = &level.chunks[slot->chunk];
+    LevelChunkLayout layout = levelChunkLayout(info->platformCount, info->coinCount,
+                                               info->enemyCount, info->groundColumns);
+
+    const Uint8* coinData = slot->payload + layout.coins;
+    int c0 = s * CHUNK_MAX_COINS;
+    size_t coinBytes = info->coinCount * sizeof(float);
+    memcpy(w->coins.x + c0, coinData + COIN_COLUMN_X * LEVEL_COLUMN_STRIDE(info->coinCount), coinBytes);
+    memcpy(w->coins.y + c0, coinData + COIN_COLUMN_Y * LEVEL_COLUMN_STRIDE(info->coinCount), coinBytes);
+    memcpy(w->coins.w + c0, coinData + COIN_COLUMN_W * LEVEL_COLUMN_STRIDE(info->coinCount), coinBytes);
+    memcpy(w->coins.h + c0, coinData + COIN_COLUMN_H * LEVEL_COLUMN_STRIDE(info->coinCount), coinBytes);
+    for (int i = 0; i < info->coinCount; i++) {
+        Uint32 id = info->firstCoin + i;
+        w->coins.collected[c0 + i] = (w->coinCollected[id / 8] >> (id % 8)) & 1;
+    }
+    for (int i = 0; i < info->coinCount; i++) w->coins.animStart[c0 + i] = w->tick;
+
+    const Uint8* enemyData = slot->payload + layout.enemies;
+    Uint64 stride = LEVEL_COLUMN_STRIDE(info->enemyCount);
+    int e0 = s * CHUNK_MAX_ENEMIES;
+    size_t enemyBytes = info->enemyCount * sizeof(float);
+    memcpy(w->enemies.x + e0, enemyData + ENEMY_COLUMN_X * stride, enemyBytes);
+    memcpy(w->enemies.y + e0, enemyData + ENEMY_COLUMN_Y * stride, enemyBytes);
+    memcpy(w->enemies.w + e0, enemyData + ENEMY_COLUMN_W * stride, enemyBytes);
+    memcpy(w->enemies.h + e0, enemyData + ENEMY_COLUMN_H * stride, enemyBytes);
+    memcpy(w->enemies.vx + e0, enemyData + ENEMY_COLUMN_VX * stride, enemyBytes);
+    memcpy(w->enemies.patrolStart + e0, enemyData + ENEMY_COLUMN_PATROL_START * stride, enemyBytes);
+    memcpy(w->enemies.patrolEnd + e0, enemyData + ENEMY_COLUMN_PATROL_END * stride, enemyBytes);
+    memcpy(w->enemies.prevX + e0, w->enemies.x + e0, enemyBytes);
+    memcpy(w->enemies.prevY + e0, w->enemies.y + e0, enemyBytes);
+    memcpy(w->enemies.spawnY + e0, w->enemies.y + e0, enemyBytes);
+
+    const float* types = (const float*)(enemyData + ENEMY_COLUMN_TYPE * stride);
+    for (int i = e0; i < e0 + info->enemyCount; i++) {
+        int type = (int)types[i - e0];
+        if (type < 0 || type >= LEVEL_ENEMY_TYPE_COUNT) type = LEVEL_ENEMY_BLUEBIRD;
+
+        w->enemies.type[i] = type;
+        w->enemies.state[i] = enemyTypes[type].brain->start;
+        w->enemies.speed[i] = SDL_fabsf(w->enemies.vx[i]);
+        w->enemies.facingRight[i] = w->enemies.vx[i] > 0;
+        w->enemies.animStart[i] = w->enemies.stateStart[i] = w->tick;
+    }
+
+    slot->populated = true;
+}
+
+static void addChunkBodies(World* w, ChunkSlot* slot);
+
+// Stamp an active chunk's terrain into its slot's window: its own platforms, the chunk before's
+// that reach into it and its ground, which is solid from its top to the bottom of the level
+void buildSlotTiles(World* w, ChunkSlot* slot) {
+    int s = slot - w->slots;
+    TileMap* map = &w->tiles;
+    clearSlotTiles(map, s, slot->chunk);
+
+    const LevelPlatform* platforms = &w->platforms[s * CHUNK_MAX_PLATFORMS];
+    for (int i = 0; i < slot->platformCount + slot->overhangCount; i++) {
+        const LevelPlatform* p = i < slot->platformCount ? &platforms[i] : &slot->overhangs[i - slot->platformCount];
+        if (!(p->flags & LEVEL_PLATFORM_ACTIVE)) continue;
+
+        TileLayer layer = (p->flags & LEVEL_PLATFORM_HAZARD) ? TILE_HAZARD :
+                          (p->flags & LEVEL_PLATFORM_SOLID) ? TILE_SOLID : TILE_ONE_WAY;
+        fillTiles(map, s, layer, p->x, p->y, p->w, p->h);
+    }
+
+    int groundY = level.table->groundY;
+    const Uint8* ground = slot->payload + slot->groundOffset;
+    for (int i = 0; i < CHUNK_WIDTH / GROUND_TILE_SIZE; i++) {
+        if (ground[i]) {
+            fillTiles(map, s, TILE_SOLID, slot->chunk * CHUNK_WIDTH + i * GROUND_TILE_SIZE, groundY,
+                      GROUND_TILE_SIZE, level.header->height - groundY);
+        }
+    }
+}
+
+// A loaded chunk joins the world: its entities go in the broadphase and start ticking, its
+// terrain starts colliding
+static void activateChunk(World* w, ChunkSlot* slot) {
+    int s = slot - w->slots;
+    const LevelChunk* info = &level.chunks[slot->chunk];
+    LevelChunkLayout layout = levelChunkLayout(info->platformCount, info->coinCount,
+                                               info->enemyCount, info->groundColumns);
+
+    slot->platformCount = info->platformCount;
+    slot->coinCount = info->coinCount;
+    slot->enemyCount = info->enemyCount;
+    slot->groundOffset = layout.ground;
+
+    // Enemies keep where they were if the chunk only went idle
+    if (!slot->populated) spawnChunk(w, slot);
+
+    int p0 = s * CHUNK_MAX_PLATFORMS;
+    memcpy(&w->platforms[p0], slot->payload + layout.platforms, info->platformCount * sizeof(LevelPlatform));
+    addChunkBodies(w, slot);
+    buildSlotTiles(w, slot);
+
+    SDL_AtomicSet(&slot->state, SLOT_ACTIVE);
+    w->activeSlots[w->activeSlotCount++] = s;
+}
+
+// Put an active chunk's coins and enemies in the broadphase, terrain collides through the tile map
+static void addChunkBodies(World* w, ChunkSlot* slot) {
+    int s = slot - w->slots;
+
+    int c0 = s * CHUNK_MAX_COINS;
+    for (int i = c0; i < c0 + slot->coinCount; i++) {
+        w->coins.body[i] = addBody(&w->grid, BODY_COIN, i, w->coins.x[i], w->coins.y[i], w->coins.w[i], w->coins.h[i]);
+    }
+
+    int e0 = s * CHUNK_MAX_ENEMIES;
+    for (int i = e0; i < e0 + slot->enemyCount; i++) {
+        w->enemies.body[i] = addBody(&w->grid, BODY_ENEMY, i, w->enemies.x[i], w->enemies.y[i], w->enemies.w[i], w->enemies.h[i]);
+    }
+}
+
+// Out of simulation range: leave the broadphase and the tile map and stop ticking, but stay resident
+static void deactivateChunk(World* w, ChunkSlot* slot) {
+    int s = slot - w->slots;
+    w->tiles.chunk[s] = -1;
+
+    for (int i = s * CHUNK_MAX_COINS; i < s * CHUNK_MAX_COINS + slot->coinCount; i++) removeBody(&w->grid, w->coins.body[i]);
+    for (int i = s * CHUNK_MAX_ENEMIES; i < s * CHUNK_MAX_ENEMIES + slot->enemyCount; i++) removeBody(&w->grid, w->enemies.body[i]);
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        if (w->activeSlots[a] == s) {
+            w->activeSlots[a] = w->activeSlots[--w->activeSlotCount];
+            break;
+        }
+    }
+
+    SDL_AtomicSet(&slot->state, SLOT_LOADED);
+}
+
+static void queueChunk(World* w, int chunk) {
+    if (findSlot(w, chunk)) return;
+
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        if (SDL_AtomicGet(&w->slots[s].state) == SLOT_FREE) {
+            w->slots[s].chunk = chunk;
+            w->slots[s].populated = false;
+
+            if (!w->streamed) {
+                const LevelChunk* info = &level.chunks[chunk];
+                memcpy(w->slots[s].payload, (const Uint8*)level.data + info->offset, info->size);
+
+                int count = chunk > 0 ? level.chunks[chunk - 1].platformCount : 0;
+                if (count > 0) {
+                    memcpy(w->slots[s].overhangs, (const Uint8*)level.data + level.chunks[chunk - 1].offset,
+                           count * sizeof(LevelPlatform));
+                }
+                keepOverhangs(&w->slots[s], count);
+                SDL_AtomicSet(&w->slots[s].state, SLOT_LOADED);
+                return;
+            }
+            SDL_AtomicSet(&w->slots[s].state, SLOT_QUEUED);
+            return;
+        }
+    }
+    // Every slot is busy, it gets queued again next tick
+}
+
+// Keep the chunks around the camera resident and the ones near it active. Waits for the
+// streamer only when a chunk inside the simulation radius hasn't arrived yet
+void updateStreaming(World* w) {
+    int simFirst = chunkAt(w->camera.x - SIM_MARGIN);
+    int simLast = chunkAt(w->camera.x + WINDOW_WIDTH + SIM_MARGIN);
+    int keepFirst = chunkAt(w->camera.x - RESIDENT_MARGIN);
+    int keepLast = chunkAt(w->camera.x + WINDOW_WIDTH + RESIDENT_MARGIN);
+
+    // Let go of what the camera has left behind
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        ChunkSlot* slot = &w->slots[s];
+        int state = SDL_AtomicGet(&slot->state);
+
+        if (state == SLOT_ACTIVE && (slot->chunk < simFirst || slot->chunk > simLast)) {
+            deactivateChunk(w, slot);
+            state = SLOT_LOADED;
+        }
+        if (state == SLOT_LOADED && (slot->chunk < keepFirst || slot->chunk > keepLast)) {
+            slot->populated = false;
+            SDL_AtomicSet(&slot->state, SLOT_FREE);
+        }
+    }
+
+    if (w->streamed) SDL_LockMutex(streamLock);
+
+    // Ask for what it is heading into, the simulation radius first
+    for (int c = simFirst; c <= simLast; c++) queueChunk(w, c);
+    for (int c = keepFirst; c <= keepLast; c++) queueChunk(w, c);
+    if (w->streamed) SDL_CondSignal(streamWake);
+
+    for (int c = simFirst; c <= simLast; c++) {
+        ChunkSlot* slot = findSlot(w, c);
+        if (!slot) continue;
+
+        while (SDL_AtomicGet(&slot->state) == SLOT_QUEUED) {
+            SDL_CondWait(streamLoaded, streamLock);
+        }
+        if (SDL_AtomicGet(&slot->state) == SLOT_LOADED) activateChunk(w, slot);
+    }
+
+    if (w->streamed) SDL_UnlockMutex(streamLock);
+}
+
+// Load an image from file as 32-bit RGBA
+SDL_Surface* loadSurface(const char* path) {
+    SDL_Surface* loadedSurface = IMG_Load(path);
+    if (loadedSurface == NULL) {
+        printf("Unable to load image %s! SDL_image Error: %s\n", path, IMG_GetError());
+        return NULL;
+    }
+
+    // Same pixel layout as the atlas pages so blits are straight copies
+    SDL_Surface* rgbaSurface = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_RGBA32, 0);
+    if (rgbaSurface == NULL) {
+        printf("Unable to convert image %s! SDL Error: %s\n", path, SDL_GetError());
+    }
+
+    SDL_FreeSurface(loadedSurface);
+
+    return rgbaSurface;
+}
+
+// Start a fresh atlas page. Texture memory starts out undefined, so it is cleared
+// once to keep the padding between sheets really empty
+static AtlasPage* addAtlasPage() {
+    if (atlasPageCount == MAX_ATLAS_PAGES) {
+        printf("Out of atlas pages!\n");
+        return NULL;
+    }
+
+    AtlasPage* page = &atlasPages[atlasPageCount];
+    page->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+                                      ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+    void* blank = calloc(ATLAS_PAGE_SIZE * ATLAS_PAGE_SIZE, 4);
+    if (!page->texture || !blank) {
+        printf("Unable to create atlas page! SDL Error: %s\n", SDL_GetError());
+        free(blank);
+        return NULL;
+    }
+    SDL_UpdateTexture(page->texture, NULL, blank, ATLAS_PAGE_SIZE * 4);
+    free(blank);
+
+    SDL_SetTextureBlendMode(page->texture, SDL_BLENDMODE_BLEND);
+    page->w = ATLAS_PAGE_SIZE;
+    page->h = ATLAS_PAGE_SIZE;
+    atlasPageCount++;
+
+    atlasShelfX = 0;
+    atlasShelfY = 0;
+    atlasShelfHeight = 0;
+    return page;
+}
+
+// Find room for a sheet with a simple shelf packer and upload it straight into its spot
+bool packSheet(SDL_Surface* sheet, Sprite* sprite, const char* path) {
+    int w = sheet->w + ATLAS_PADDING;
+    int h = sheet->h + ATLAS_PADDING;
+
+    if (w > ATLAS_PAGE_SIZE || h > ATLAS_PAGE_SIZE) {
+        printf("Sprite sheet %s is too big for the atlas!\n", path);
+        return false;
+    }
+
+    // Next shelf, or next page when this one is full
+    if (atlasPageCount > 0 && atlasShelfX + w > ATLAS_PAGE_SIZE) {
+        atlasShelfX = 0;
+        atlasShelfY += atlasShelfHeight;
+        atlasShelfHeight = 0;
+    }
+    if (atlasPageCount == 0 || atlasShelfY + h > ATLAS_PAGE_SIZE) {
+        if (!addAtlasPage()) return false;
+    }
+
+    AtlasPage* page = &atlasPages[atlasPageCount - 1];
+    SDL_Rect dest = { atlasShelfX, atlasShelfY, sheet->w, sheet->h };
+    if (SDL_UpdateTexture(page->texture, &dest, sheet->pixels, sheet->pitch) < 0) {
+        printf("Unable to upload %s! SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    sprite->page = page;
+    sprite->rect = dest;
+
+    atlasShelfX += w;
+    if (h > atlasShelfHeight) atlasShelfHeight = h;
+    return true;
+}
+
+// Map the archive assetpack builds. Without one the sheets are decoded from their PNGs
+bool openAssetArchive(const char* path) {
+    if (!mapFile(path, &assetArchive)) {
+        SDL_Log("No asset archive at %s, decoding PNGs", path);
+        return false;
+    }
+
+    const AssetHeader* header = assetArchive.data;
+    if (assetArchive.size < sizeof(AssetHeader) || header->magic != ASSET_MAGIC || header->version != ASSET_VERSION ||
+        sizeof(AssetHeader) + (Uint64)header->entryCount * sizeof(AssetEntry) > assetArchive.size) {
+        printf("%s is not a version %d asset archive!\n", path, ASSET_VERSION);
+        closeAssetArchive();
+        return false;
+    }
+
+    assetEntries = (const AssetEntry*)((const Uint8*)assetArchive.data + sizeof(AssetHeader));
+    assetEntryCount = header->entryCount;
+
+    for (int i = 0; i < assetEntryCount; i++) {
+        const AssetEntry* e = &assetEntries[i];
+        if (e->offset > assetArchive.size || e->size > assetArchive.size - e->offset ||
+            e->w <= 0 || e->h <= 0 || e->pitch < e->w * 4 ||
+            (e->compression == ASSET_RAW && e->size < (Uint64)e->pitch * e->h)) {
+            printf("Asset archive %s has a bad entry %d!\n", path, i);
+            closeAssetArchive();
+            return false;
+        }
+    }
+
+    SDL_Log("Mapped asset archive %s: %d images", path, assetEntryCount);
+    return true;
+}
+
+void closeAssetArchive() {
+    unmapFile(&assetArchive);
+    assetEntries = NULL;
+    assetEntryCount = 0;
+}
+
+// Entries are sorted by name
+const AssetEntry* findAsset(const char* name) {
+    int lo = 0, hi = assetEntryCount - 1;
+
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int order = strncmp(name, assetEntries[mid].name, ASSET_NAME_MAX);
+        if (order == 0) return &assetEntries[mid];
+        if (order < 0) hi = mid - 1;
+        else lo = mid + 1;
+    }
+    return NULL;
+}
+
+// Raw entries are wrapped in place over the mapped pages, LZ4 ones are inflated into a new surface
+SDL_Surface* archiveSurface(const AssetEntry* entry) {
+    const Uint8* blob = (const Uint8*)assetArchive.data + entry->offset;
+
+    if (entry->compression == ASSET_RAW) {
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom((void*)blob, entry->w, entry->h, 32,
+                                                                  entry->pitch, SDL_PIXELFORMAT_RGBA32);
+        if (!surface) printf("Unable to wrap %s! SDL Error: %s\n", entry->name, SDL_GetError());
+        return surface;
+    }
+
+#ifdef USE_LZ4
+    if (entry->compression == ASSET_LZ4) {
+        SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, entry->w, entry->h, 32, SDL_PIXELFORMAT_RGBA32);
+        if (!surface) {
+            printf("Unable to create surface for %s! SDL Error: %s\n", entry->name, SDL_GetError());
+            return NULL;
+        }
+
+        // Rows are tightly packed in the archive, the surface may pad them
+        int rawSize = entry->pitch * entry->h;
+        char* pixels = surface->pitch == entry->pitch ? surface->pixels : malloc(rawSize);
+        if (!pixels || LZ4_decompress_safe((const char*)blob, pixels, entry->size, rawSize) != rawSize) {
+            printf("Unable to inflate %s!\n", entry->name);
+            if (pixels != surface->pixels) free(pixels);
+            SDL_FreeSurface(surface);
+            return NULL;
+        }
+        if (pixels != surface->pixels) {
+            for (int y = 0; y < entry->h; y++) {
+                memcpy((Uint8*)surface->pixels + y * surface->pitch, pixels + y * entry->pitch, entry->w * 4);
+            }
+            free(pixels);
+        }
+        return surface;
+    }
+#endif
+
+    printf("%s is compressed in a way this build can't read!\n", entry->name);
+    return NULL;
+}
+
+// Decode worker: take the next sheet off the list until there are none left
+static int decodeSheets(void* data) {
+    (void)data;
+    PROFILE_THREAD("decode");
+
+    for (;;) {
+        int j = SDL_AtomicAdd(&nextDecodeJob, 1);
+        if (j >= decodeJobCount) break;
+
+        DecodeJob* job = &decodeJobs[j];
+        if (SDL_AtomicGet(&job->state) != DECODE_PENDING) continue;
+
+        PROFILE_BEGIN(decodeSheet);
+        job->surface = job->entry ? archiveSurface(job->entry) : loadSurface(job->sheet->path);
+        PROFILE_END(decodeSheet);
+        SDL_AtomicSet(&job->state, job->surface ? DECODE_DONE : DECODE_FAILED);
+        SDL_SemPost(decodeFinished);
+    }
+    return 0;
+}
+
+// Kick off decoding every sheet in the background, critical ones first. Sheets stored raw
+// in the asset archive need no decoding and are ready straight away
+bool startAssetLoading(SpriteSheet* sheets, int count) {
+    openAssetArchive(ASSET_ARCHIVE_PATH);
+
+    decodeJobCount = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < count; i++) {
+            if (sheets[i].critical != (pass == 0)) continue;
+            DecodeJob* job = &decodeJobs[decodeJobCount++];
+            job->sheet = &sheets[i];
+            job->entry = assetEntries ? findAsset(sheets[i].path) : NULL;
+            job->surface = NULL;
+            job->uploaded = false;
+            SDL_AtomicSet(&job->state, DECODE_PENDING);
+        }
+    }
+    SDL_AtomicSet(&nextDecodeJob, 0);
+    assetsUploaded = 0;
+
+    decodeFinished = SDL_CreateSemaphore(0);
+    if (!decodeFinished) {
+        printf("Unable to start the asset loader! SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    int pending = 0;
+    for (int j = 0; j < decodeJobCount; j++) {
+        DecodeJob* job = &decodeJobs[j];
+        if (job->entry && job->entry->compression == ASSET_RAW) {
+            job->surface = archiveSurface(job->entry);
+            SDL_AtomicSet(&job->state, job->surface ? DECODE_DONE : DECODE_FAILED);
+        } else {
+            pending++;
+        }
+    }
+    if (pending == 0) return true;
+
+    // Leave a core for the main thread, which builds the glyph caches meanwhile
+    decodeWorkerCount = SDL_GetCPUCount() - 1;
+    if (decodeWorkerCount > MAX_DECODE_WORKERS) decodeWorkerCount = MAX_DECODE_WORKERS;
+    if (decodeWorkerCount > pending) decodeWorkerCount = pending;
+    if (decodeWorkerCount < 1) decodeWorkerCount = 1;
+
+    for (int i = 0; i < decodeWorkerCount; i++) {
+        decodeWorkers[i] = SDL_CreateThread(decodeSheets, "asset decoder", NULL);
+        if (!decodeWorkers[i]) {
+            printf("Unable to start an asset decoder! SDL Error: %s\n", SDL_GetError());
+            decodeWorkerCount = i;
+            break;
+        }
+    }
+
+    // Without any workers the main thread decodes everything itself
+    if (decodeWorkerCount == 0) decodeSheets(NULL);
+    return true;
+}
+
+// Upload whatever has finished decoding, tallest first so the shelves pack tightly.
+// Returns false if a critical sheet could not be loaded
+static bool uploadDecodedSheets() {
+    int ready[SPRITE_SHEET_COUNT];
+    int readyCount = 0;
+    bool ok = true;
+
+    for (int j = 0; j < decodeJobCount; j++) {
+        DecodeJob* job = &decodeJobs[j];
+        if (job->uploaded) continue;
+
+        int state = SDL_AtomicGet(&job->state);
+        if (state == DECODE_PENDING) continue;
+
+        if (state == DECODE_FAILED) {
+            job->uploaded = true;
+            assetsUploaded++;
+            if (job->sheet->critical) ok = false;
+            continue;
+        }
+
+        int k = readyCount++;
+        while (k > 0 && decodeJobs[ready[k - 1]].surface->h < job->surface->h) {
+            ready[k] = ready[k - 1];
+            k--;
+        }
+        ready[k] = j;
+    }
+
+    for (int k = 0; k < readyCount; k++) {
+        DecodeJob* job = &decodeJobs[ready[k]];
+        Sprite* sprite = job->sheet->sprite;
+        if (!packSheet(job->surface, sprite, job->sheet->path) && job->sheet->critical) ok = false;
+
+        if (job->entry) {
+            sprite->frameW = job->entry->frameW;
+            sprite->frameH = job->entry->frameH;
+        } else {
+            assetFrameSize(job->sheet->path, sprite->rect.w, sprite->rect.h, &sprite->frameW, &sprite->frameH);
+        }
+
+        SDL_FreeSurface(job->surface);
+        job->surface = NULL;
+        job->uploaded = true;
+        assetsUploaded++;
+    }
+
+    return ok;
+}
+
+// Block until everything the first frame needs is on the atlas, reporting progress as sheets arrive
+bool waitForCriticalAssets(AssetProgressFn progress) {
+    for (;;) {
+        int decoded = 0;
+        bool criticalPending = false;
+
+        for (int j = 0; j < decodeJobCount; j++) {
+            if (SDL_AtomicGet(&decodeJobs[j].state) != DECODE_PENDING) {
+                decoded++;
+            } else if (decodeJobs[j].sheet->critical) {
+                criticalPending = true;
+            }
+        }
+
+        if (progress) progress(decoded, decodeJobCount);
+        if (!criticalPending) break;
+
+        SDL_SemWaitTimeout(decodeFinished, 100);
+    }
+
+    if (!uploadDecodedSheets()) {
+        printf("Failed to load a critical sprite sheet!\n");
+        return false;
+    }
+
+    SDL_Log("Startup: critical sprites ready at %.1f ms (%d decode threads)",
+            millisecondsSinceStartup(), decodeWorkerCount);
+    return true;
+}
+
+// Once a frame: upload sheets that finished in the background and retire the pool when done
+void pumpAssets() {
+    if (!decodeFinished) return;
+
+    uploadDecodedSheets();
+
+    if (assetsUploaded == decodeJobCount) {
+        stopAssetLoading();
+        SDL_Log("Startup: all %d sprite sheets on %d atlas page(s) at %.1f ms",
+                decodeJobCount, atlasPageCount, millisecondsSinceStartup());
+    }
+}
+
+void stopAssetLoading() {
+    for (int i = 0; i < decodeWorkerCount; i++) {
+        SDL_WaitThread(decodeWorkers[i], NULL);
+    }
+    decodeWorkerCount = 0;
+
+    for (int j = 0; j < decodeJobCount; j++) {
+        SDL_FreeSurface(decodeJobs[j].surface);
+        decodeJobs[j].surface = NULL;
+    }
+
+    if (decodeFinished) SDL_DestroySemaphore(decodeFinished);
+    decodeFinished = NULL;
+
+    // Nothing points into the archive once every sheet is on the atlas
+    closeAssetArchive();
+}
+
+// Headless runs never decode or upload a sheet, the simulation only needs their sizes
+// for the animation frame counts. Read from the asset archive or the PNG header
+bool loadSpriteSizes(SpriteSheet* sheets, int count) {
+    openAssetArchive(ASSET_ARCHIVE_PATH);
+
+    for (int i = 0; i < count; i++) {
+        Sprite* sprite = sheets[i].sprite;
+        const AssetEntry* entry = assetEntries ? findAsset(sheets[i].path) : NULL;
+
+        if (entry) {
+            sprite->rect = (SDL_Rect){ 0, 0, entry->w, entry->h };
+            sprite->frameW = entry->frameW;
+            sprite->frameH = entry->frameH;
+            continue;
+        }
+
+        // Width and height are the first fields of the IHDR chunk, right after the signature
+        Uint8 signature[8];
+        SDL_RWops* file = SDL_RWFromFile(sheets[i].path, "rb");
+        bool ok = file && SDL_RWread(file, signature, sizeof(signature), 1) == 1 &&
+                  memcmp(signature, "\x89PNG\r\n\x1a\n", sizeof(signature)) == 0 &&
+                  SDL_RWseek(file, 16, RW_SEEK_SET) == 16;
+        if (ok) {
+            sprite->rect.w = (int)SDL_ReadBE32(file);
+            sprite->rect.h = (int)SDL_ReadBE32(file);
+        }
+        if (file) SDL_RWclose(file);
+
+        if (!ok || sprite->rect.w <= 0 || sprite->rect.h <= 0) {
+            printf("Unable to read the size of %s!\n", sheets[i].path);
+            if (sheets[i].critical) return false;
+            continue;
+        }
+        assetFrameSize(sheets[i].path, sprite->rect.w, sprite->rect.h, &sprite->frameW, &sprite->frameH);
+    }
+
+    closeAssetArchive();
+    return true;
+}
+
+// Loading screen: a bar filling up as sheets are decoded
+void drawLoadingProgress(int loaded, int total) {
+    SDL_Rect outline = { WINDOW_WIDTH / 4, WINDOW_HEIGHT / 2 - 10, WINDOW_WIDTH / 2, 20 };
+    SDL_Rect fill = outline;
+    fill.w = total > 0 ? outline.w * loaded / total : outline.w;
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderClear(renderer);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    SDL_RenderFillRect(renderer, &fill);
+    SDL_RenderDrawRect(renderer, &outline);
+    SDL_RenderPresent(renderer);
+
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+}
+
+double millisecondsSinceStartup() {
+    return (double)(SDL_GetPerformanceCounter() - startupCounter) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+// Load every size from a baked .font file. Coverage is expanded to white RGBA so
+// glyphs are tinted by the vertex colour like before
+bool loadBakedFonts(const char* path) {
+    size_t size = 0;
+    Uint8* data = SDL_LoadFile(path, &size);
+    if (!data) {
+        printf("Failed to load font %s! SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    const FontFileHeader* header = (const FontFileHeader*)data;
+    const FontSize* sizes = (const FontSize*)(data + sizeof(FontFileHeader));
+    bool ok = size >= sizeof(FontFileHeader) && header->magic == FONT_MAGIC && header->version == FONT_VERSION &&
+              sizeof(FontFileHeader) + (Uint64)header->sizeCount * sizeof(FontSize) <= size;
+    if (!ok) printf("%s is not a version %d baked font!\n", path, FONT_VERSION);
+
+    for (Uint32 s = 0; ok && s < header->sizeCount; s++) {
+        const FontSize* baked = &sizes[s];
+        Uint64 pageBytes = (Uint64)baked->pageW * baked->pageH;
+
+        if (glyphFontCount == MAX_GLYPH_FONTS) {
+            printf("Too many font sizes in %s!\n", path);
+            ok = false;
+            break;
+        }
+        if (baked->pageW <= 0 || baked->pageH <= 0 || baked->pixelOffset > size || pageBytes > size - baked->pixelOffset) {
+            printf("Font %s has a bad size table!\n", path);
+            ok = false;
+            break;
+        }
+
+        GlyphFont* font = &glyphFonts[glyphFontCount];
+        font->size = baked->size;
+        font->height = baked->height;
+        for (int c = 0; c < FONT_GLYPH_COUNT; c++) {
+            const FontGlyph* g = &baked->glyphs[c];
+            font->glyphs[c].rect = (SDL_Rect){ g->x, g->y, g->w, g->h };
+            font->glyphs[c].advance = g->advance;
+        }
+
+        SDL_Surface* page = SDL_CreateRGBSurfaceWithFormat(0, baked->pageW, baked->pageH, 32, SDL_PIXELFORMAT_RGBA32);
+        if (!page) {
+            printf("Unable to create glyph page! SDL Error: %s\n", SDL_GetError());
+            ok = false;
+            break;
+        }
+
+        const Uint8* coverage = data + baked->pixelOffset;
+        for (int y = 0; y < baked->pageH; y++) {
+            Uint8* row = (Uint8*)page->pixels + y * page->pitch;
+            for (int x = 0; x < baked->pageW; x++) {
+                row[x * 4 + 0] = 255;
+                row[x * 4 + 1] = 255;
+                row[x * 4 + 2] = 255;
+                row[x * 4 + 3] = coverage[y * baked->pageW + x];
+            }
+        }
+
+        font->page.texture = SDL_CreateTextureFromSurface(renderer, page);
+        font->page.w = baked->pageW;
+        font->page.h = baked->pageH;
+        SDL_FreeSurface(page);
+
+        if (!font->page.texture) {
+            printf("Unable to create glyph texture! SDL Error: %s\n", SDL_GetError());
+            ok = false;
+            break;
+        }
+        SDL_SetTextureBlendMode(font->page.texture, SDL_BLENDMODE_BLEND);
+
+        glyphFontCount++;
+    }
+
+    SDL_free(data);
+    return ok;
+}
+
+// A size baked into the font file, rebake with fontbake to add one
+GlyphFont* findGlyphFont(int size) {
+    for (int i = 0; i < glyphFontCount; i++) {
+        if (glyphFonts[i].size == size) return &glyphFonts[i];
+    }
+
+    printf("Font size %d isn't baked into %s!\n", size, FONT_PATH);
+    return NULL;
+}
+
+// Width of a string in pixels
+int measureText(const GlyphFont* font, const char* text) {
+    int width = 0;
+    for (const char* c = text; *c; c++) {
+        if (*c < FIRST_GLYPH || *c > LAST_GLYPH) continue;
+        width += font->glyphs[*c - FIRST_GLYPH].advance;
+    }
+    return width;
+}
+
+// Rebuild a label's quads, but only if something about it changed
+void setLabel(TextLabel* label, GlyphFont* font, const char* text, int x, int y, SDL_Color color) {
+    if (label->font == font && label->x == x && label->y == y &&
+        label->color.r == color.r && label->color.g == color.g &&
+        label->color.b == color.b && label->color.a == color.a &&
+        strcmp(label->text, text) == 0) {
+        return;
+    }
+
+    label->font = font;
+    label->x = x;
+    label->y = y;
+    label->color = color;
+    snprintf(label->text, sizeof(label->text), "%s", text);
+    label->quadCount = 0;
+
+    float penX = x;
+    for (const char* c = label->text; *c; c++) {
+        if (*c < FIRST_GLYPH || *c > LAST_GLYPH) continue;
+
+        const Glyph* glyph = &font->glyphs[*c - FIRST_GLYPH];
+        if (glyph->rect.w > 0) {
+            float u0 = (float)glyph->rect.x / font->page.w;
+            float v0 = (float)glyph->rect.y / font->page.h;
+            float u1 = (float)(glyph->rect.x + glyph->rect.w) / font->page.w;
+            float v1 = (float)(glyph->rect.y + glyph->rect.h) / font->page.h;
+            float w = glyph->rect.w;
+            float h = glyph->rect.h;
+
+            SDL_Vertex* v = &label->vertices[label->quadCount * 4];
+            v[0] = (SDL_Vertex){ { penX, y }, color, { u0, v0 } };
+            v[1] = (SDL_Vertex){ { penX + w, y }, color, { u1, v0 } };
+            v[2] = (SDL_Vertex){ { penX + w, y + h }, color, { u1, v1 } };
+            v[3] = (SDL_Vertex){ { penX, y + h }, color, { u0, v1 } };
+            label->quadCount++;
+        }
+        penX += glyph->advance;
+    }
+}
+
+// Append a label's cached quads to the batch
+void drawLabel(const TextLabel* label) {
+    if (!label->font || label->quadCount == 0) return;
+
+    if (label->font->page.texture != batchTexture || batchQuads + label->quadCount > MAX_BATCH_QUADS) {
+        flushBatch();
+        batchTexture = label->font->page.texture;
+    }
+
+    memcpy(&batchVertices[batchQuads * 4], label->vertices, label->quadCount * 4 * sizeof(SDL_Vertex));
+    batchQuads += label->quadCount;
+}
+
+// Load media (images)
+// Sprite sheets decode in the background while the glyph pages are uploaded here
+bool loadMedia(AssetProgressFn progress) {
+    if (!startAssetLoading(spriteSheets, SPRITE_SHEET_COUNT)) {
+        return false;
+    }
+
+    if (!loadBakedFonts(FONT_PATH)) {
+        return false;
+    }
+
+    hudFont = findGlyphFont(HUD_FONT_SIZE);
+    messageFont = findGlyphFont(MESSAGE_FONT_SIZE);
+    if (!hudFont || !messageFont) {
+        printf("Failed to build glyph cache!\n");
+        return false;
+    }
+
+    initBatch();
+
+    if (!waitForCriticalAssets(progress)) {
+        printf("Failed to build texture atlas!\n");
+        return false;
+    }
+
+    // Every animated sheet is critical, so their sizes are known now
+    initClips();
+
+    return true;
+}
+
+// 16-byte aligned so SIMD code can use it. NULL once the arena is full, which only a frame
+// far bigger than anything the game draws would do
+void* arenaAlloc(Arena* arena, size_t size) {
+    if (!arena->base) {
+        arena->base = malloc(SCRATCH_ARENA_SIZE);
+        arena->capacity = arena->base ? SCRATCH_ARENA_SIZE : 0;
+    }
+
+    size_t start = (arena->used + 15) & ~(size_t)15;
+    if (start + size > arena->capacity) return NULL;
+
+    arena->used = start + size;
+    return arena->base + start;
+}
+
+// Format into the arena, "" if it is full
+char* arenaPrintf(Arena* arena, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char* text = length >= 0 ? arenaAlloc(arena, length + 1) : NULL;
+    if (!text) return "";
+
+    va_start(args, format);
+    vsnprintf(text, length + 1, format, args);
+    va_end(args);
+    return text;
+}
+
+void resetArena(Arena* arena) {
+    arena->used = 0;
+}
+
+void freeArena(Arena* arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->used = arena->capacity = 0;
+}
+
+// The index pattern never changes, fill it once
+void initBatch() {
+    for (int q = 0; q < MAX_BATCH_QUADS; q++) {
+        batchIndices[q * 6 + 0] = q * 4 + 0;
+        batchIndices[q * 6 + 1] = q * 4 + 1;
+        batchIndices[q * 6 + 2] = q * 4 + 2;
+        batchIndices[q * 6 + 3] = q * 4 + 2;
+        batchIndices[q * 6 + 4] = q * 4 + 3;
+        batchIndices[q * 6 + 5] = q * 4 + 0;
+    }
+}
+
+// Submit everything queued so far
+void flushBatch() {
+    if (batchQuads == 0) return;
+
+    SDL_RenderGeometry(renderer, batchTexture, batchVertices, batchQuads * 4, batchIndices, batchQuads * 6);
+    drawCalls++;
+    batchQuads = 0;
+}
+
+// Queue one quad showing region of an atlas page, tinted by color
+void drawQuad(AtlasPage* page, SDL_Rect region, float x, float y, float w, float h, bool flip, SDL_Color color) {
+    if (page->texture != batchTexture || batchQuads == MAX_BATCH_QUADS) {
+        flushBatch();
+        batchTexture = page->texture;
+    }
+
+    float u0 = (float)region.x / page->w;
+    float v0 = (float)region.y / page->h;
+    float u1 = (float)(region.x + region.w) / page->w;
+    float v1 = (float)(region.y + region.h) / page->h;
+
+    if (flip) {
+        float t = u0;
+        u0 = u1;
+        u1 = t;
+    }
+
+    SDL_Vertex* v = &batchVertices[batchQuads * 4];
+    v[0] = (SDL_Vertex){ { x, y }, color, { u0, v0 } };
+    v[1] = (SDL_Vertex){ { x + w, y }, color, { u1, v0 } };
+    v[2] = (SDL_Vertex){ { x + w, y + h }, color, { u1, v1 } };
+    v[3] = (SDL_Vertex){ { x, y + h }, color, { u0, v1 } };
+    batchQuads++;
+}
+
+// Queue one sprite. src is relative to the sprite sheet, NULL means the whole sheet
+void drawSprite(const Sprite* sprite, const SDL_Rect* src, float x, float y, float w, float h, bool flip) {
+    drawTintedSprite(sprite, src, x, y, w, h, flip, (SDL_Color){ 255, 255, 255, 255 });
+}
+
+void drawTintedSprite(const Sprite* sprite, const SDL_Rect* src, float x, float y, float w, float h, bool flip, SDL_Color color) {
+    if (!sprite->page) return;     // still loading
+
+    SDL_Rect region = sprite->rect;
+    if (src) {
+        region.x += src->x;
+        region.y += src->y;
+        region.w = src->w;
+        region.h = src->h;
+    }
+
+    drawQuad(sprite->page, region, x, y, w, h, flip, color);
+}
+
+
+bool initSDL() {
+    if (SDL_Init(headless ? 0 : SDL_INIT_VIDEO) < 0) {
+        SDL_Log("SDL could not initialize! SDL_Error: %s", SDL_GetError());
+        return false;
+    }
+    if (headless) return true;
+
+    int imgFlags = IMG_INIT_PNG;
+    if (!(IMG_Init(imgFlags) & imgFlags)) {
+        SDL_Log("SDL_image could not initialize! SDL_image Error: %s", IMG_GetError());
+        return false;
+    }
+
+    window = SDL_CreateWindow(
+        "2D Platformer",
+        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+        WINDOW_WIDTH, WINDOW_HEIGHT,
+        SDL_WINDOW_RESIZABLE
+    );
+
+    if (!window) {
+        SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
+        return false;
+    }
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (!renderer) {
+        // No GPU, draw in software instead
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+    if (!renderer) {
+        SDL_Log("Renderer could not be created! SDL_Error: %s", SDL_GetError());
+        return false;
+    }
+
+    initDamageTracking();
+    return true;
+}
+
+// Only worth it in software, a GPU redraws the whole window faster than it tracks damage
+bool initDamageTracking() {
+    SDL_RendererInfo info;
+    if (SDL_GetRendererInfo(renderer, &info) < 0) return false;
+    if (!(info.flags & SDL_RENDERER_SOFTWARE) || !(info.flags & SDL_RENDERER_TARGETTEXTURE)) return false;
+
+    staticTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT);
+    sceneTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!staticTexture || !sceneTexture) {
+        SDL_Log("No damage tracking, render targets failed: %s", SDL_GetError());
+        if (staticTexture) SDL_DestroyTexture(staticTexture);
+        if (sceneTexture) SDL_DestroyTexture(sceneTexture);
+        staticTexture = sceneTexture = NULL;
+        return false;
+    }
+
+    SDL_SetTextureBlendMode(staticTexture, SDL_BLENDMODE_NONE);
+    SDL_SetTextureBlendMode(sceneTexture, SDL_BLENDMODE_NONE);
+    damageTracking = true;
+    sceneValid = false;
+    SDL_Log("Software renderer, redrawing only what changes");
+    return true;
+}
+
+
+void cleanupSDL() {
+    stopAssetLoading();
+
+    if (staticTexture) SDL_DestroyTexture(staticTexture);
+    if (sceneTexture) SDL_DestroyTexture(sceneTexture);
+    staticTexture = sceneTexture = NULL;
+    damageTracking = false;
+    freeTerrainStrips();
+
+    for (int i = 0; i < atlasPageCount; i++) {
+        SDL_DestroyTexture(atlasPages[i].texture);
+        atlasPages[i].texture = NULL;
+    }
+    atlasPageCount = 0;
+
+    for (int i = 0; i < glyphFontCount; i++) {
+        SDL_DestroyTexture(glyphFonts[i].page.texture);
+        glyphFonts[i].page.texture = NULL;
+    }
+    glyphFontCount = 0;
+
+    IMG_Quit();
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+}
+
+
+void handleEvents(bool* running) {
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            *running = false;
+        }
+        // Render targets lose their pixels when the device resets
+        if (event.type == SDL_RENDER_TARGETS_RESET) {
+            sceneValid = false;
+            invalidateTerrain(0, level.header->width);
+        }
+#ifdef PROFILE
+        // F3 toggles the profiler overlay, F4 captures a trace
+        if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+            if (event.key.keysym.sym == SDLK_F3) profileOverlay = !profileOverlay;
+            if (event.key.keysym.sym == SDLK_F4) startProfileCapture();
+        }
+#endif
+    }
+}
+
+
+void handleInput(Player* player, Uint8 input) {
+    const float moveSpeed = 5.0f;
+    const float jumpStrength = -12.0f;
+
+    if (input & INPUT_LEFT) {
+        player->vx = -moveSpeed;
+        player->facingLeft = true;
+    } else if (input & INPUT_RIGHT) {
+        player->vx = moveSpeed;
+        player->facingLeft = false;
+    } else {
+        player->vx = 0;
+    }
+
+    if ((input & INPUT_JUMP) && player->onGround) {
+        player->vy = jumpStrength;
+        player->onGround = false;
+    }
+}
+
+
+void savePreviousPositions(World* w) {
+    Player* player = &w->player;
+
+    player->prevX = player->x;
+    player->prevY = player->y;
+
+    // Only active slots move
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        size_t bytes = w->slots[w->activeSlots[a]].enemyCount * sizeof(float);
+        memcpy(w->enemies.prevX + first, w->enemies.x + first, bytes);
+        memcpy(w->enemies.prevY + first, w->enemies.y + first, bytes);
+    }
+
+    memcpy(w->bullets.prevX, w->bullets.x, w->bullets.count * sizeof(float));
+}
+
+
+void updatePhysics(World* w) {
+    Player* player = &w->player;
+
+    const float gravity = 0.5f;
+
+    // Integrated so a tick of any length lands on the same arc REFERENCE_TICK_RATE ticks trace
+    float dx = player->vx * TICK_SCALE;
+    float dy = player->vy * TICK_SCALE;
+    if (!player->onGround) { //gravity
+        dy = player->vy * TICK_SCALE + gravity * TICK_SCALE * (TICK_SCALE + 1) / 2;
+        player->vy += gravity * TICK_SCALE;
+    }
+
+    if (player->x + dx < 0) dx = -player->x;
+    if (player->x + dx > level.header->width - player->w) dx = level.header->width - player->w - player->x;
+
+    player->onGround = false;
+    movePlayer(&w->tiles, player, dx, dy);
+
+   
+    // Standing still holds the run clip on its first frame
+    if (player->vx == 0) player->animStart = w->tick;
+
+    
+    updateEnemyStates(w);
+    for (int a = 0; a < w->activeSlotCount; a++) {  //enemy
+        ChunkSlot* slot = &w->slots[w->activeSlots[a]];
+        updateEnemies(&w->enemies, w->activeSlots[a] * CHUNK_MAX_ENEMIES, slot->enemyCount);
+    }
+    updateBullets(w);
+}
+
+// Columns are SIMD-aligned and padded so kernels can always run whole registers
+// Bytes a world takes: the struct and one bit per coin in the level, rounded to a cache line
+// so worlds can sit side by side
+size_t worldSize() {
+    size_t size = sizeof(World) + (level.table->coinCount + 7) / 8 + 1;
+    return (size + 63) & ~(size_t)63;
+}
+
+size_t snapshotSize() {
+    return worldSize() - SNAPSHOT_START;
+}
+
+// A world with nothing in it yet, resetGame brings in the level. w points at worldSize()
+// bytes. Everything but the broadphase and the tile map is part of that block
+bool initWorld(World* w) {
+    memset(w, 0, worldSize());
+    w->camera = (SDL_Rect){ 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
+
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        w->slots[s].chunk = -1;
+        SDL_AtomicSet(&w->slots[s].state, SLOT_FREE);
+    }
+
+    // Sized for every slot being full. Chunks add and remove their bodies as they
+    // activate and deactivate, enemies are kept up to date by syncEnemyBodies
+    if (!initGrid(&w->grid, MAX_RESIDENT_CHUNKS * (CHUNK_MAX_PLATFORMS + CHUNK_MAX_COINS + CHUNK_MAX_ENEMIES)) ||
+        !initTileMap(&w->tiles)) {
+        printf("Out of memory for a world!\n");
+        freeWorld(w);
+        return false;
+    }
+
+    return true;
+}
+
+void freeWorld(World* w) {
+    freeGrid(&w->grid);
+    freeTileMap(&w->tiles);
+    if (w->rewind) {
+        free(w->rewind->data);
+        free(w->rewind);
+        w->rewind = NULL;
+    }
+}
+
+// The streamer only writes slots that are queued, so once none are, holding its lock keeps it
+// out of the world entirely. Snapshots never hold a half-read chunk
+static void lockStreamedWorld(World* w) {
+    if (!w->streamed) return;
+
+    SDL_LockMutex(streamLock);
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        while (SDL_AtomicGet(&w->slots[s].state) == SLOT_QUEUED) {
+            SDL_CondWait(streamLoaded, streamLock);
+        }
+    }
+}
+
+static void unlockStreamedWorld(World* w) {
+    if (w->streamed) SDL_UnlockMutex(streamLock);
+}
+
+// Copy the world's game state out, snapshotSize() bytes
+void saveWorld(World* w, void* snapshot) {
+    lockStreamedWorld(w);
+    w->savedAt = w->tick;
+    memcpy(snapshot, (Uint8*)w + SNAPSHOT_START, snapshotSize());
+    unlockStreamedWorld(w);
+}
+
+// Put a snapshot back, taken from this world or any other on the same level. The broadphase
+// and terrain cells aren't in it, so they are refilled from the chunks that are active, which never costs more than
+// MAX_RESIDENT_CHUNKS full chunks however big the level gets. The tick isn't in it either, the
+// clock keeps running, so every tick stamp is moved on by the time since the snapshot was saved
+void restoreWorld(World* w, const void* snapshot) {
+    lockStreamedWorld(w);
+    memcpy((Uint8*)w + SNAPSHOT_START, snapshot, snapshotSize());
+
+    Uint32 shift = w->tick - w->savedAt;
+    w->player.animStart += shift;
+    for (int i = 0; i < MAX_COINS; i++) w->coins.animStart[i] += shift;
+    for (int i = 0; i < MAX_ENEMIES; i++) {
+        w->enemies.animStart[i] += shift;
+        w->enemies.stateStart[i] += shift;
+    }
+    for (int i = 0; i < w->bullets.count; i++) w->bullets.expires[i] += shift;
+    w->savedAt = w->tick;
+    unlockStreamedWorld(w);
+
+    clearGrid(&w->grid);
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) w->tiles.chunk[s] = -1;
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        addChunkBodies(w, &w->slots[w->activeSlots[a]]);
+        buildSlotTiles(w, &w->slots[w->activeSlots[a]]);
+    }
+}
+
+// Give the world a rewind history. Only the game's own world has one
+bool initRewind(World* w) {
+    w->rewind = calloc(1, sizeof(RewindRing));
+    if (w->rewind) w->rewind->data = malloc(REWIND_SNAPSHOTS * snapshotSize());
+    if (!w->rewind || !w->rewind->data) {
+        printf("Out of memory for the rewind history!\n");
+        freeWorld(w);
+        return false;
+    }
+    return true;
+}
+
+void pushRewind(World* w) {
+    RewindRing* ring = w->rewind;
+    ring->newest = (ring->newest + 1) % REWIND_SNAPSHOTS;
+    if (ring->count < REWIND_SNAPSHOTS) ring->count++;
+
+    ring->ticks[ring->newest] = w->tick;
+    saveWorld(w, ring->data + (size_t)ring->newest * snapshotSize());
+}
+
+// Go back to the newest snapshot, or the one before if that was taken moments ago, so pressing
+// rewind again keeps going further back. Works while dying too, as an instant retry
+bool rewindWorld(World* w) {
+    RewindRing* ring = w->rewind;
+    if (!ring || ring->count == 0) return false;
+
+    if (w->tick - ring->ticks[ring->newest] < REWIND_INTERVAL / 2 && ring->count > 1) {
+        ring->newest = (ring->newest + REWIND_SNAPSHOTS - 1) % REWIND_SNAPSHOTS;
+        ring->count--;
+    }
+
+    restoreWorld(w, ring->data + (size_t)ring->newest * snapshotSize());
+    ring->ticks[ring->newest] = w->tick;
+    return true;
+}
+
+// True if a walker stepping by vx this tick would have no ground under its leading foot
+static bool enemyAtLedge(const World* w, int i, float vx) {
+    const EnemyStore* e = &w->enemies;
+    float x = e->x[i] + vx * TICK_SCALE;
+    float foot = vx < 0 ? x : x + e->w[i] - 1;
+    return groundProbe(&w->tiles, foot, 1, e->y[i] + e->h[i], TILE_SIZE) >= TILE_SIZE;
+}
+
+// Flyers drift back to their flight height while they aren't bobbing, so the bob starts from it
+static void settleEnemy(EnemyStore* e, int i) {
+    e->y[i] += SDL_clamp(e->spawnY[i] - e->y[i], -TICK_SCALE, TICK_SCALE);
+}
+
+static void patrolEnemies(World* w, const int* enemies, int count) {
+    EnemyStore* e = &w->enemies;
+
+    for (int k = 0; k < count; k++) {
+        int i = enemies[k];
+        e->vx[i] = e->vx[i] < 0 ? -e->speed[i] : e->speed[i];
+    }
+}
+
+// The phase is wrapped to one period in whole ticks, so sinf never sees a large argument
+static void flySineEnemies(World* w, const int* enemies, int count) {
+    EnemyStore* e = &w->enemies;
+
+    for (int k = 0; k < count; k++) {
+        int i = enemies[k];
+        const EnemyType* type = &enemyTypes[e->type[i]];
+        Uint32 period = REFERENCE_TICKS(type->bobPeriod);
+        float phase = (float)((w->tick - e->stateStart[i]) % period) * (2 * (float)M_PI / period);
+
+        e->vx[i] = e->vx[i] < 0 ? -e->speed[i] : e->speed[i];
+        e->y[i] = e->spawnY[i] + type->bobHeight * SDL_sinf(phase);
+    }
+}
+
+static void chaseEnemies(World* w, const int* enemies, int count) {
+    EnemyStore* e = &w->enemies;
+    float playerX = w->player.x + w->player.w / 2;
+
+    for (int k = 0; k < count; k++) {
+        int i = enemies[k];
+        const EnemyType* type = &enemyTypes[e->type[i]];
+        float vx = playerX < e->x[i] + e->w[i] / 2 ? -type->speed : type->speed;
+        float x = e->x[i] + vx * TICK_SCALE;
+
+        bool blocked = x <= e->patrolStart[i] || x >= e->patrolEnd[i] || (!type->flies && enemyAtLedge(w, i, vx));
+        e->vx[i] = blocked ? 0 : vx;
+        e->facingRight[i] = vx > 0;
+        settleEnemy(e, i);
+    }
+}
+
+// The first shot comes a whole interval after the player is seen
+static void shootEnemies(World* w, const int* enemies, int count) {
+    EnemyStore* e = &w->enemies;
+    float playerX = w->player.x + w->player.w / 2;
+
+    for (int k = 0; k < count; k++) {
+        int i = enemies[k];
+        const EnemyType* type = &enemyTypes[e->type[i]];
+        float x = e->x[i] + e->w[i] / 2;
+
+        e->vx[i] = 0;
+        e->facingRight[i] = playerX > x;
+        settleEnemy(e, i);
+
+        Uint32 elapsed = w->tick - e->stateStart[i];
+        if (elapsed > 0 && elapsed % REFERENCE_TICKS(type->fireInterval) == 0) {
+            fireBullet(w, e->type[i], x, e->y[i] + e->h[i] / 2, e->facingRight[i] ? BULLET_SPEED : -BULLET_SPEED);
+        }
+    }
+}
+
+// Sets off toward the player and keeps going, turning at the patrol bounds and ledges
+static void dashEnemies(World* w, const int* enemies, int count) {
+    EnemyStore* e = &w->enemies;
+    float playerX = w->player.x + w->player.w / 2;
+
+    for (int k = 0; k < count; k++) {
+        int i = enemies[k];
+        const EnemyType* type = &enemyTypes[e->type[i]];
+        float vx = e->vx[i] < 0 ? -type->speed : type->speed;
+        if (w->tick == e->stateStart[i]) vx = playerX < e->x[i] + e->w[i] / 2 ? -type->speed : type->speed;
+        if (!type->flies && enemyAtLedge(w, i, vx)) vx = -vx;
+
+        e->vx[i] = vx;
+        settleEnemy(e, i);
+    }
+}
+
+typedef void (*EnemyKernel)(World* w, const int* enemies, int count);
+
+static const EnemyKernel enemyKernels[ENEMY_STATE_COUNT] = {
+    [ENEMY_PATROL] = patrolEnemies,
+    [ENEMY_FLY_SINE] = flySineEnemies,
+    [ENEMY_CHASE] = chaseEnemies,
+    [ENEMY_SHOOT] = shootEnemies,
+    [ENEMY_DASH] = dashEnemies,
+};
+
+// Move every active enemy to the state its event leads to, then run each state's kernel over the
+// enemies in it. Sight is a box around the enemy and a ray through the solid cells between the
+// centres, only cast when the player is in the box. The buckets are a counting sort on the
+// scratch arena, in slot order so a tick always runs the same way. They are taken before any
+// enemy changes state, so a full arena leaves the tick's states as they were, not half applied
+void updateEnemyStates(World* w) {
+    EnemyStore* e = &w->enemies;
+    const Player* player = &w->player;
+    float playerX = player->x + player->w / 2;
+    float playerY = player->y + player->h / 2;
+    int counts[ENEMY_STATE_COUNT] = { 0 };
+
+    int total = 0;
+    for (int a = 0; a < w->activeSlotCount; a++) total += w->slots[w->activeSlots[a]].enemyCount;
+    int* buckets = ARENA_ARRAY(&scratch, int, total);
+    int starts[ENEMY_STATE_COUNT], fill[ENEMY_STATE_COUNT];
+    if (!buckets) return;
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        int end = first + w->slots[w->activeSlots[a]].enemyCount;
+
+        for (int i = first; i < end; i++) {
+            const EnemyType* type = &enemyTypes[e->type[i]];
+            float x = e->x[i] + e->w[i] / 2;
+            float y = e->y[i] + e->h[i] / 2;
+            int duration = type->duration[e->state[i]];
+
+            EnemyEvent event = ENEMY_LOST_PLAYER;
+            if (duration > 0 && w->tick - e->stateStart[i] >= (Uint32)REFERENCE_TICKS(duration)) {
+                event = ENEMY_TIMED_OUT;
+            } else if (SDL_fabsf(playerX - x) < type->sightRange && SDL_fabsf(playerY - y) < type->sightRange / 2 &&
+                       !raycastTiles(&w->tiles, x, y, playerX, playerY, TILE_MASK(TILE_SOLID), NULL, NULL)) {
+                event = ENEMY_SEES_PLAYER;
+            }
+
+            Uint8 next = type->brain->next[e->state[i]][event];
+            if (next != e->state[i]) {
+                e->state[i] = next;
+                e->stateStart[i] = w->tick;
+            }
+            counts[next]++;
+        }
+    }
+
+    for (int s = 0, offset = 0; s < ENEMY_STATE_COUNT; s++) {
+        starts[s] = fill[s] = offset;
+        offset += counts[s];
+    }
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        int end = first + w->slots[w->activeSlots[a]].enemyCount;
+        for (int i = first; i < end; i++) buckets[fill[e->state[i]]++] = i;
+    }
+
+    for (int s = 0; s < ENEMY_STATE_COUNT; s++) {
+        if (counts[s] > 0) enemyKernels[s](w, buckets + starts[s], counts[s]);
+    }
+}
+
+// Patrol move and turn at the patrol bounds for a range of enemies.
+// The vector paths give exactly the same results as the scalar loop, which also handles the tail
+void updateEnemies(EnemyStore* e, int first, int count) {
+    int i = first;
+    int end = first + count;
+
+#if defined(__AVX2__)
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+    const __m256 scale = _mm256_set1_ps(TICK_SCALE);
+
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(e->x + i);
+        __m256 vx = _mm256_loadu_ps(e->vx + i);
+        x = _mm256_add_ps(x, _mm256_mul_ps(vx, scale));
+
+        // vx *= -1 wherever x <= patrolStart || x >= patrolEnd
+        __m256 turn = _mm256_or_ps(_mm256_cmp_ps(x, _mm256_loadu_ps(e->patrolStart + i), _CMP_LE_OQ),
+                                   _mm256_cmp_ps(x, _mm256_loadu_ps(e->patrolEnd + i), _CMP_GE_OQ));
+        vx = _mm256_xor_ps(vx, _mm256_and_ps(turn, signBit));
+
+        _mm256_storeu_ps(e->x + i, x);
+        _mm256_storeu_ps(e->vx + i, vx);
+    }
+#elif defined(__SSE2__)
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 scale = _mm_set1_ps(TICK_SCALE);
+
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(e->x + i);
+        __m128 vx = _mm_loadu_ps(e->vx + i);
+        x = _mm_add_ps(x, _mm_mul_ps(vx, scale));
+
+        // vx *= -1 wherever x <= patrolStart || x >= patrolEnd
+        __m128 turn = _mm_or_ps(_mm_cmple_ps(x, _mm_loadu_ps(e->patrolStart + i)),
+                                _mm_cmpge_ps(x, _mm_loadu_ps(e->patrolEnd + i)));
+        vx = _mm_xor_ps(vx, _mm_and_ps(turn, signBit));
+
+        _mm_storeu_ps(e->x + i, x);
+        _mm_storeu_ps(e->vx + i, vx);
+    }
+#endif
+
+    for (; i < end; i++) {
+        e->x[i] += e->vx[i] * TICK_SCALE;
+
+        if (e->x[i] <= e->patrolStart[i] || e->x[i] >= e->patrolEnd[i]) {
+            e->vx[i] *= -1;
+        }
+    }
+
+    // Standing still keeps the way it faced
+    for (i = first; i < end; i++) {
+        if (e->vx[i] != 0) e->facingRight[i] = e->vx[i] > 0;
+    }
+}
+
+// A shot from x, y (its centre) flying at vx. Dropped if there are MAX_BULLETS in the air
+void fireBullet(World* w, int type, float x, float y, float vx) {
+    BulletStore* b = &w->bullets;
+    if (b->count == MAX_BULLETS) return;
+
+    int i = b->count++;
+    b->x[i] = b->prevX[i] = x - BULLET_SIZE / 2;
+    b->y[i] = y - BULLET_SIZE / 2;
+    b->vx[i] = vx;
+    b->expires[i] = w->tick + BULLET_TICKS;
+    b->type[i] = type;
+}
+
+// Fly every shot on, removing the ones that time out, leave the level or hit solid terrain on the
+// way. Removal swaps the last one in
+void updateBullets(World* w) {
+    BulletStore* b = &w->bullets;
+
+    for (int i = 0; i < b->count; i++) {
+        float y = b->y[i] + BULLET_SIZE / 2;
+        float fromX = b->x[i] + BULLET_SIZE / 2;
+        b->x[i] += b->vx[i] * TICK_SCALE;
+        float toX = b->x[i] + BULLET_SIZE / 2;
+
+        if (w->tick >= b->expires[i] || toX < 0 || toX >= level.header->width ||
+            raycastTiles(&w->tiles, fromX, y, toX, y, TILE_MASK(TILE_SOLID), NULL, NULL)) {
+            int last = --b->count;
+            b->x[i] = b->x[last];
+            b->y[i] = b->y[last];
+            b->vx[i] = b->vx[last];
+            b->prevX[i] = b->prevX[last];
+            b->expires[i] = b->expires[last];
+            b->type[i] = b->type[last];
+            i--;
+        }
+    }
+}
+
+static void countClipFrames(AnimClip* clip) {
+    if (clip->frameW == 0) clip->frameW = clip->sprite->frameW;
+    if (clip->frameH == 0) clip->frameH = clip->sprite->frameH;
+    clip->frameCount = clip->frameW > 0 ? clip->sprite->rect.w / clip->frameW : 0;
+}
+
+// Count each clip's frames along its sheet. Every enemy type plays its one sheet
+void initClips() {
+    for (int c = 0; c < CLIP_COUNT; c++) countClipFrames(&clips[c]);
+
+    for (int t = 0; t < LEVEL_ENEMY_TYPE_COUNT; t++) {
+        enemyClips[t] = (AnimClip){ .sprite = &enemySprites[t], .ticksPerFrame = REFERENCE_TICKS(6) };
+        countClipFrames(&enemyClips[t]);
+    }
+}
+
+// Source rect of the frame a clip started at start shows at tick
+SDL_Rect clipFrame(const AnimClip* clip, Uint32 tick, Uint32 start) {
+    int frame = clip->frameCount > 0 ? (int)((tick - start) / clip->ticksPerFrame % clip->frameCount) : 0;
+    return (SDL_Rect){ frame * clip->frameW, 0, clip->frameW, clip->frameH };
+}
+
+// Size the grid for roughly this many bodies, the entry pool grows on demand
+bool initGrid(Grid* g, int expectedBodies) {
+    int buckets = 64;
+    while (buckets < expectedBodies * 2) buckets *= 2;
+
+    g->bodyCapacity = expectedBodies;
+    g->entryCapacity = expectedBodies * 4;
+    g->bodies = malloc(g->bodyCapacity * sizeof(Body));
+    g->entries = malloc(g->entryCapacity * sizeof(GridEntry));
+    g->buckets = malloc(buckets * sizeof(int));
+    if (!g->bodies || !g->entries || !g->buckets) {
+        printf("Out of memory for the collision grid!\n");
+        freeGrid(g);
+        return false;
+    }
+
+    g->bucketMask = buckets - 1;
+    clearGrid(g);
+    return true;
+}
+
+// Empty the grid, keeping its storage
+void clearGrid(Grid* g) {
+    for (int i = 0; i <= g->bucketMask; i++) g->buckets[i] = -1;
+
+    // Every entry starts on the free list
+    for (int i = 0; i < g->entryCapacity; i++) g->entries[i].next = i + 1;
+    g->entries[g->entryCapacity - 1].next = -1;
+    g->freeEntry = 0;
+
+    g->bodyCount = 0;
+    g->bodyFree = -1;
+    g->queryStamp = 0;
+}
+
+void freeGrid(Grid* g) {
+    free(g->bodies);
+    free(g->entries);
+    free(g->buckets);
+    g->bodies = NULL;
+    g->entries = NULL;
+    g->buckets = NULL;
+    g->bodyCount = g->bodyCapacity = g->entryCapacity = 0;
+    g->freeEntry = -1;
+}
+
+static int gridHash(const Grid* g, int cellX, int cellY) {
+    return (int)(((unsigned)cellX * 73856093u) ^ ((unsigned)cellY * 19349663u)) & g->bucketMask;
+}
+
+static int cellOf(float v) {
+    return (int)SDL_floorf(v / GRID_CELL_SIZE);
+}
+
+static void gridInsert(Grid* g, int body, int cellX, int cellY) {
+    if (g->freeEntry < 0) {
+        int oldCapacity = g->entryCapacity;
+        GridEntry* grown = realloc(g->entries, oldCapacity * 2 * sizeof(GridEntry));
+        if (!grown) {
+            printf("Out of memory for the collision grid!\n");
+            return;
+        }
+        g->entries = grown;
+        g->entryCapacity = oldCapacity * 2;
+        for (int i = oldCapacity; i < g->entryCapacity; i++) g->entries[i].next = i + 1;
+        g->entries[g->entryCapacity - 1].next = -1;
+        g->freeEntry = oldCapacity;
+    }
+
+    int e = g->freeEntry;
+    int bucket = gridHash(g, cellX, cellY);
+    g->freeEntry = g->entries[e].next;
+    g->entries[e] = (GridEntry){ body, cellX, cellY, g->buckets[bucket] };
+    g->buckets[bucket] = e;
+}
+
+static void gridRemove(Grid* g, int body, int cellX, int cellY) {
+    int bucket = gridHash(g, cellX, cellY);
+    int* link = &g->buckets[bucket];
+
+    while (*link >= 0) {
+        GridEntry* entry = &g->entries[*link];
+        if (entry->body == body && entry->cellX == cellX && entry->cellY == cellY) {
+            int e = *link;
+            *link = entry->next;
+            g->entries[e].next = g->freeEntry;
+            g->freeEntry = e;
+            return;
+        }
+        link = &entry->next;
+    }
+}
+
+// Register a collidable, returns its body id
+int addBody(Grid* g, BodyType type, int index, float x, float y, float w, float h) {
+    if (g->bodyFree < 0 && g->bodyCount == g->bodyCapacity) {
+        int capacity = g->bodyCapacity ? g->bodyCapacity * 2 : 64;
+        Body* grown = realloc(g->bodies, capacity * sizeof(Body));
+        if (!grown) {
+            printf("Out of memory for the collision grid!\n");
+            return -1;
+        }
+        g->bodies = grown;
+        g->bodyCapacity = capacity;
+    }
+
+    int id = g->bodyFree >= 0 ? g->bodyFree : g->bodyCount++;
+    Body* b = &g->bodies[id];
+    if (id == g->bodyFree) g->bodyFree = b->index;
+    b->type = type;
+    b->index = index;
+    b->minCellX = cellOf(x);
+    b->minCellY = cellOf(y);
+    b->maxCellX = cellOf(x + w);
+    b->maxCellY = cellOf(y + h);
+    b->queryStamp = 0;
+
+    for (int cy = b->minCellY; cy <= b->maxCellY; cy++) {
+        for (int cx = b->minCellX; cx <= b->maxCellX; cx++) {
+            gridInsert(g, id, cx, cy);
+        }
+    }
+    return id;
+}
+
+// Update a moving body, the grid is only touched when it crosses into different cells
+void moveBody(Grid* g, int body, float x, float y, float w, float h) {
+    Body* b = &g->bodies[body];
+    int minX = cellOf(x), minY = cellOf(y);
+    int maxX = cellOf(x + w), maxY = cellOf(y + h);
+
+    if (minX == b->minCellX && minY == b->minCellY && maxX == b->maxCellX && maxY == b->maxCellY) {
+        return;
+    }
+
+    for (int cy = b->minCellY; cy <= b->maxCellY; cy++) {
+        for (int cx = b->minCellX; cx <= b->maxCellX; cx++) {
+            gridRemove(g, body, cx, cy);
+        }
+    }
+
+    b->minCellX = minX;
+    b->minCellY = minY;
+    b->maxCellX = maxX;
+    b->maxCellY = maxY;
+
+    for (int cy = minY; cy <= maxY; cy++) {
+        for (int cx = minX; cx <= maxX; cx++) {
+            gridInsert(g, body, cx, cy);
+        }
+    }
+}
+
+// Take a body out of the grid, its id goes back on the free list
+void removeBody(Grid* g, int body) {
+    Body* b = &g->bodies[body];
+
+    for (int cy = b->minCellY; cy <= b->maxCellY; cy++) {
+        for (int cx = b->minCellX; cx <= b->maxCellX; cx++) {
+            gridRemove(g, body, cx, cy);
+        }
+    }
+
+    b->type = 0;
+    b->index = g->bodyFree;
+    g->bodyFree = body;
+}
+
+// Collect bodies of the given types in the cells an AABB touches. Callers still do the exact test
+int queryGrid(Grid* g, float x, float y, float w, float h, int typeMask, int* results, int maxResults) {
+    int minX = cellOf(x), minY = cellOf(y);
+    int maxX = cellOf(x + w), maxY = cellOf(y + h);
+    int count = 0;
+
+    // A body spanning several cells must only be reported once
+    g->queryStamp++;
+
+    for (int cy = minY; cy <= maxY; cy++) {
+        for (int cx = minX; cx <= maxX; cx++) {
+            for (int e = g->buckets[gridHash(g, cx, cy)]; e >= 0; e = g->entries[e].next) {
+                GridEntry* entry = &g->entries[e];
+                if (entry->cellX != cx || entry->cellY != cy) continue;
+
+                Body* b = &g->bodies[entry->body];
+                if (!(b->type & typeMask) || b->queryStamp == g->queryStamp) continue;
+
+                b->queryStamp = g->queryStamp;
+                if (count < maxResults) results[count++] = entry->body;
+            }
+        }
+    }
+    return count;
+}
+
+void syncEnemyBodies(World* w) {
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        for (int i = first; i < first + w->slots[w->activeSlots[a]].enemyCount; i++) {
+            moveBody(&w->grid, w->enemies.body[i], w->enemies.x[i], w->enemies.y[i], w->enemies.w[i], w->enemies.h[i]);
+        }
+    }
+}
+
+// Check collisions 
+// Moves the player through the tile map, across and then down or up, stopping against the first
+// cell in the way. Each axis visits every column or row its leading edge crosses, so however far
+// a tick moves nothing is passed through. Across, solid cells are walls except in the bottom
+// MAX_STEP_UP of the body, walking back onto a ledge just stepped off lands on it. Up, solid
+// cells are ceilings. Down, feet land on top of the first surface they reach or are in, one-way
+// ones included. Below the level counts as its bottom row, so ground goes down forever, a body
+// fallen below the level still meets the side of the ground in it
+void movePlayer(const TileMap* map, Player* player, float dx, float dy) {
+    int row0 = SDL_min((int)SDL_floorf(player->y / TILE_SIZE), map->rows - 1);
+    int row1 = (int)SDL_ceilf((player->y + player->h - MAX_STEP_UP) / TILE_SIZE) - 1;
+
+    if (dx > 0) {
+        int first = (int)SDL_ceilf((player->x + player->w) / TILE_SIZE) - 1;
+        int last = (int)SDL_ceilf((player->x + player->w + dx) / TILE_SIZE) - 1;
+        player->x += dx;
+        for (int c = first; c <= last; c++) {
+            if (tilesAny(map, TILE_MASK(TILE_SOLID), c, c, row0, row1)) {
+                player->x = c * TILE_SIZE - player->w;
+                break;
+            }
+        }
+    } else if (dx < 0) {
+        int first = (int)SDL_floorf(player->x / TILE_SIZE);
+        int last = (int)SDL_floorf((player->x + dx) / TILE_SIZE);
+        player->x += dx;
+        for (int c = first; c >= last; c--) {
+            if (tilesAny(map, TILE_MASK(TILE_SOLID), c, c, row0, row1)) {
+                player->x = (c + 1) * TILE_SIZE;
+                break;
+            }
+        }
+    }
+
+    int column0, column1;
+    tileColumns(player->x, player->w, &column0, &column1);
+
+    if (dy < 0) {
+        int first = (int)SDL_ceilf(player->y / TILE_SIZE) - 1;
+        int last = (int)SDL_floorf((player->y + dy) / TILE_SIZE);
+        player->y += dy;
+        for (int r = first; r >= last; r--) {
+            if (tilesAny(map, TILE_MASK(TILE_SOLID), column0, column1, r, r)) {
+                player->y = (r + 1) * TILE_SIZE;
+                player->vy = 0;
+                break;
+            }
+        }
+    } else {
+        // From the row the feet are in, or just above if they rest on a cell boundary
+        float feetY = player->y + player->h;
+        int first = SDL_min((int)SDL_ceilf(feetY / TILE_SIZE) - 1, map->rows - 1);
+        int last = SDL_min((int)SDL_floorf((feetY + dy) / TILE_SIZE), map->rows - 1);
+        player->y += dy;
+        for (int r = first; r <= last; r++) {
+            if (tilesAny(map, TILE_SURFACE, column0, column1, r, r)) {
+                int top = r;
+                while (tilesAny(map, TILE_SURFACE, column0, column1, top - 1, top - 1)) top--;
+
+                player->y = top * TILE_SIZE - player->h;
+                player->vy = 0;
+                player->onGround = true;
+                break;
+            }
+        }
+    }
+}
+
+// Touching a hazard ends the life
+void checkTerrainCollisions(World* w) {
+    Player* player = &w->player;
+    int column0, column1;
+    tileColumns(player->x, player->w, &column0, &column1);
+
+    int row0 = (int)SDL_floorf(player->y / TILE_SIZE);
+    int row1 = (int)SDL_ceilf((player->y + player->h) / TILE_SIZE) - 1;
+    if (tilesAny(&w->tiles, TILE_MASK(TILE_HAZARD), column0, column1, row0, row1)) {
+        endLife(w, GAME_DYING, "Game Over! Touched a hazard!", (SDL_Color){255, 0, 0, 255});
+        w->deaths++;
+    }
+}
+
+void checkCollisions(World* w) {
+    Player* player = &w->player;
+
+    int nearby[MAX_QUERY_RESULTS];
+    int count = queryGrid(&w->grid, player->x, player->y, player->w, player->h, BODY_COIN, nearby, MAX_QUERY_RESULTS);
+
+    for (int k = 0; k < count; k++) {
+        int i = w->grid.bodies[nearby[k]].index;
+        if (w->coins.collected[i]) continue;
+
+        if (player->x + player->w > w->coins.x[i] &&
+            player->x < w->coins.x[i] + w->coins.w[i] &&
+            player->y + player->h > w->coins.y[i] &&
+            player->y < w->coins.y[i] + w->coins.h[i]) {
+            w->coins.collected[i] = true;
+            w->score++;
+            w->coinsTaken++;
+
+            // Remembered level-wide so the coin stays gone if its chunk is streamed out
+            Uint32 id = level.chunks[w->slots[i / CHUNK_MAX_COINS].chunk].firstCoin + i % CHUNK_MAX_COINS;
+            w->coinCollected[id / 8] |= 1 << (id % 8);
+            if (!headless) SDL_Log("Coin collected! Score: %d", w->score);
+        }
+    }
+}
+
+
+void checkEnemyCollisions(World* w) {
+    Player* player = &w->player;
+
+    int nearby[MAX_QUERY_RESULTS];
+    int count = queryGrid(&w->grid, player->x, player->y, player->w, player->h, BODY_ENEMY, nearby, MAX_QUERY_RESULTS);
+
+    for (int k = 0; k < count; k++) {
+        int i = w->grid.bodies[nearby[k]].index;
+        if (player->x + player->w > w->enemies.x[i] &&
+            player->x < w->enemies.x[i] + w->enemies.w[i] &&
+            player->y + player->h > w->enemies.y[i] &&
+            player->y < w->enemies.y[i] + w->enemies.h[i]) {
+            
+            endLife(w, GAME_DYING, "Game Over! Hit by enemy!", (SDL_Color){255, 0, 0, 255});
+            w->deaths++;
+            break;
+        }
+    }
+}
+
+
+// Bullets are few, so they're tested against the player directly rather than through the grid
+void checkBulletCollisions(World* w) {
+    const Player* player = &w->player;
+    const BulletStore* b = &w->bullets;
+
+    for (int i = 0; i < b->count; i++) {
+        if (player->x + player->w > b->x[i] && player->x < b->x[i] + BULLET_SIZE &&
+            player->y + player->h > b->y[i] && player->y < b->y[i] + BULLET_SIZE) {
+            endLife(w, GAME_DYING, "Game Over! Shot by enemy!", (SDL_Color){255, 0, 0, 255});
+            w->deaths++;
+            break;
+        }
+    }
+}
+
+// Enemies that bump into each other both turn around. Each overlapping pair the broadphase
+// finds is resolved straight away; turning only changes velocities, so it can't change which
+// pairs overlap and the order is the same as gathering them first
+void checkEnemyEnemyCollisions(World* w) {
+    int nearby[MAX_QUERY_RESULTS];
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        int end = first + w->slots[w->activeSlots[a]].enemyCount;
+
+        for (int i = first; i < end; i++) {
+            int count = queryGrid(&w->grid, w->enemies.x[i], w->enemies.y[i], w->enemies.w[i], w->enemies.h[i], BODY_ENEMY, nearby, MAX_QUERY_RESULTS);
+
+            for (int k = 0; k < count; k++) {
+                int j = w->grid.bodies[nearby[k]].index;
+                if (j <= i) continue;      // each pair once
+
+                if (!(w->enemies.x[i] + w->enemies.w[i] > w->enemies.x[j] && w->enemies.x[i] < w->enemies.x[j] + w->enemies.w[j] &&
+                      w->enemies.y[i] + w->enemies.h[i] > w->enemies.y[j] && w->enemies.y[i] < w->enemies.y[j] + w->enemies.h[j])) continue;
+
+                // Only turn when heading into each other, or they'd flip every tick while overlapping
+                bool approaching = (w->enemies.x[i] < w->enemies.x[j]) ? (w->enemies.vx[i] > w->enemies.vx[j])
+                                                                       : (w->enemies.vx[i] < w->enemies.vx[j]);
+                if (approaching) {
+                    w->enemies.vx[i] *= -1;
+                    w->enemies.vx[j] *= -1;
+                }
+            }
+        }
+    }
+}
+
+
+// The life is over, hold the world under a message until the reset. The message is always
+// opaque, its colour is the glyphs' vertex colour and they're blended
+void endLife(World* w, GameState state, const char* message, SDL_Color color) {
+    w->state = state;
+    w->stateTicks = MESSAGE_TICKS;
+    w->message = message;
+    w->messageColor = color;
+    w->messageColor.a = 255;
+}
+
+// Count down the message, then reset. Ticks keep coming the whole time, so nothing stalls
+void updateGameState(World* w) {
+    switch (w->state) {
+    case GAME_DYING:
+    case GAME_WON:
+        if (--w->stateTicks <= 0) w->state = GAME_RESETTING;
+        break;
+    case GAME_RESETTING:
+        resetGame(w);
+        break;
+    case GAME_PLAYING:
+        break;
+    }
+}
+
+// Dim the scene and put the world's message in the middle
+void drawMessage(const RenderSnapshot* s) {
+    SDL_Rect screen = { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 192);
+    SDL_RenderFillRect(renderer, &screen);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+
+    static TextLabel messageLabel;     // kept so a repeated message is not laid out again
+    setLabel(&messageLabel, messageFont, s->message,
+             WINDOW_WIDTH / 2 - measureText(messageFont, s->message) / 2,
+             WINDOW_HEIGHT / 2 - messageFont->height / 2,
+             s->messageColor);
+    drawLabel(&messageLabel);
+    flushBatch();
+}
+
+
+void checkGoalCollision(World* w) {
+    Player* player = &w->player;
+
+    const LevelRect* goal = level.goal;
+
+    if (player->x + player->w > goal->x &&
+        player->x < goal->x + goal->w &&
+        player->y + player->h > goal->y &&
+        player->y < goal->y + goal->h) {
+        
+        endLife(w, GAME_WON, "You win!", (SDL_Color){255, 255, 0, 255});
+        w->wins++;
+    }
+}
+
+
+void checkFallDetection(World* w) {
+    Player* player = &w->player;
+
+    // 100 px below the bottom of the level, not of the window
+    if (player->y > level.header->height + 100) {
+        endLife(w, GAME_DYING, "Game Over! You fell!", (SDL_Color){255, 0, 0, 255});
+        w->deaths++;
+    }
+}
+
+
+// FNV-1a, chained through hash
+Uint32 hashBytes(Uint32 hash, const void* data, size_t size) {
+    const Uint8* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Everything a tick can change: the player, the score, collected coins, the live enemies and bullets
+Uint32 hashState(const World* w) {
+    const Player* player = &w->player;
+    Uint32 hash = 2166136261u;
+    float body[4] = { player->x, player->y, player->vx, player->vy };
+    int flags[3] = { player->onGround, player->facingLeft, (int)(w->tick - player->animStart) };
+
+    hash = hashBytes(hash, body, sizeof(body));
+    hash = hashBytes(hash, flags, sizeof(flags));
+    hash = hashBytes(hash, &w->score, sizeof(w->score));
+    hash = hashBytes(hash, &w->state, sizeof(w->state));
+    hash = hashBytes(hash, &w->stateTicks, sizeof(w->stateTicks));
+    hash = hashBytes(hash, w->coinCollected, (level.table->coinCount + 7) / 8);
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        int count = w->slots[w->activeSlots[a]].enemyCount;
+
+        hash = hashBytes(hash, w->enemies.x + first, count * sizeof(float));
+        hash = hashBytes(hash, w->enemies.y + first, count * sizeof(float));
+        hash = hashBytes(hash, w->enemies.vx + first, count * sizeof(float));
+        hash = hashBytes(hash, w->enemies.state + first, count);
+    }
+
+    hash = hashBytes(hash, &w->bullets.count, sizeof(w->bullets.count));
+    hash = hashBytes(hash, w->bullets.x, w->bullets.count * sizeof(float));
+    hash = hashBytes(hash, w->bullets.y, w->bullets.count * sizeof(float));
+    return hash;
+}
+
+Uint8 sampleInput() {
+    const Uint8 *keys = SDL_GetKeyboardState(NULL);
+    Uint8 input = 0;
+
+    if (keys[SDL_SCANCODE_LEFT] || keys[SDL_SCANCODE_A]) input |= INPUT_LEFT;
+    if (keys[SDL_SCANCODE_RIGHT] || keys[SDL_SCANCODE_D]) input |= INPUT_RIGHT;
+    if (keys[SDL_SCANCODE_UP] || keys[SDL_SCANCODE_SPACE]) input |= INPUT_JUMP;
+    if (keys[SDL_SCANCODE_R] || keys[SDL_SCANCODE_BACKSPACE]) input |= INPUT_REWIND;
+    return input;
+}
+
+void startRecording(const char* path) {
+    replayMode = REPLAY_RECORDING;
+    replayPath = path;
+    SDL_Log("Recording input to %s", path);
+}
+
+static bool growReplay(void** array, Uint32* capacity, size_t size) {
+    Uint32 grown = *capacity ? *capacity * 2 : 4096;
+    void* larger = realloc(*array, grown * size);
+    if (!larger) return false;
+
+    *array = larger;
+    *capacity = grown;
+    return true;
+}
+
+// Append a recorded tick, extending the last run when the input didn't change
+void recordTick(Uint8 input, Uint32 hash) {
+    if (replayTickCount == replayTickCapacity &&
+        !growReplay((void**)&replayHashes, &replayTickCapacity, sizeof(Uint32))) {
+        printf("Out of memory recording input, recording stopped\n");
+        replayMode = REPLAY_OFF;
+        return;
+    }
+
+    ReplayRun* last = replayRunCount ? &replayRuns[replayRunCount - 1] : NULL;
+    if (last && last->input == input && last->length < 0xFFFF) {
+        last->length++;
+    } else {
+        if (replayRunCount == replayRunCapacity &&
+            !growReplay((void**)&replayRuns, &replayRunCapacity, sizeof(ReplayRun))) {
+            printf("Out of memory recording input, recording stopped\n");
+            replayMode = REPLAY_OFF;
+            return;
+        }
+        replayRuns[replayRunCount++] = (ReplayRun){ 1, input, 0 };
+    }
+
+    replayHashes[replayTickCount++] = hash;
+}
+
+bool saveRecording() {
+    FILE* file = fopen(replayPath, "wb");
+    if (!file) {
+        printf("Unable to write recording %s!\n", replayPath);
+        return false;
+    }
+
+    ReplayHeader header = { REPLAY_MAGIC, REPLAY_VERSION, hashBytes(2166136261u, level.data, level.size),
+                            replayTickCount, replayRunCount, TICK_RATE };
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(replayRuns, sizeof(ReplayRun), replayRunCount, file) == replayRunCount &&
+              fwrite(replayHashes, sizeof(Uint32), replayTickCount, file) == replayTickCount;
+    ok = fclose(file) == 0 && ok;
+
+    if (ok) {
+        SDL_Log("Recorded %u ticks in %u runs to %s", replayTickCount, replayRunCount, replayPath);
+    } else {
+        printf("Unable to write recording %s!\n", replayPath);
+    }
+    return ok;
+}
+
+bool loadReplay(const char* path) {
+    size_t size = 0;
+    Uint8* data = SDL_LoadFile(path, &size);
+    if (!data) {
+        printf("Failed to load replay %s! SDL Error: %s\n", path, SDL_GetError());
+        return false;
+    }
+
+    ReplayHeader header;
+    bool ok = size >= sizeof(header);
+    if (ok) {
+        memcpy(&header, data, sizeof(header));
+        ok = header.magic == REPLAY_MAGIC && header.version == REPLAY_VERSION &&
+             size == sizeof(header) + (Uint64)header.runCount * sizeof(ReplayRun) + (Uint64)header.tickCount * sizeof(Uint32);
+    }
+    if (!ok) {
+        printf("%s is not a version %d replay!\n", path, REPLAY_VERSION);
+        SDL_free(data);
+        return false;
+    }
+
+    if (header.tickRate != TICK_RATE) {
+        printf("%s was recorded at %u ticks per second, this build runs %d!\n", path, header.tickRate, TICK_RATE);
+        SDL_free(data);
+        return false;
+    }
+
+    if (header.levelHash != hashBytes(2166136261u, level.data, level.size)) {
+        printf("Warning: %s was recorded on a different level, it will diverge\n", path);
+    }
+
+    replayRuns = malloc(header.runCount * sizeof(ReplayRun) + 1);
+    replayHashes = malloc(header.tickCount * sizeof(Uint32) + 1);
+    if (!replayRuns || !replayHashes) {
+        printf("Out of memory loading replay %s!\n", path);
+        SDL_free(data);
+        return false;
+    }
+    memcpy(replayRuns, data + sizeof(header), header.runCount * sizeof(ReplayRun));
+    memcpy(replayHashes, data + sizeof(header) + header.runCount * sizeof(ReplayRun), header.tickCount * sizeof(Uint32));
+    SDL_free(data);
+
+    replayRunCount = header.runCount;
+    replayTickCount = header.tickCount;
+    replayMode = REPLAY_PLAYING;
+    replayPath = path;
+    SDL_Log("Replaying %u ticks from %s", replayTickCount, path);
+    return true;
+}
+
+// Input for the next tick: the keyboard, or the replay. False once the replay has run out
+bool nextInput(Uint8* input) {
+    if (replayMode != REPLAY_PLAYING) {
+        *input = headless ? randomInput() : (Uint8)SDL_AtomicGet(&liveInput);
+        return true;
+    }
+
+    while (replayRun < replayRunCount && replayRunTick == replayRuns[replayRun].length) {
+        replayRun++;
+        replayRunTick = 0;
+    }
+    if (replayRun == replayRunCount || replayTick == replayTickCount) return false;
+
+    *input = replayRuns[replayRun].input;
+    replayRunTick++;
+    return true;
+}
+
+// After every tick: append it to the recording, or check the replay hasn't diverged
+void finishTick(Uint8 input, const World* w) {
+    if (replayMode == REPLAY_RECORDING) {
+        recordTick(input, hashState(w));
+    } else if (replayMode == REPLAY_PLAYING) {
+        Uint32 hash = hashState(w);
+        if (hash != replayHashes[replayTick] && replayDivergedAt < 0) {
+            printf("Replay diverged at tick %u (state %08x, recorded %08x)\n", replayTick, hash, replayHashes[replayTick]);
+            replayDivergedAt = replayTick;
+        }
+        replayTick++;
+    }
+}
+
+void stopReplay() {
+    if (replayMode == REPLAY_RECORDING) {
+        saveRecording();
+    } else if (replayMode == REPLAY_PLAYING) {
+        if (replayDivergedAt < 0) {
+            SDL_Log("Replay matched for all %u of %u ticks", replayTick, replayTickCount);
+        } else {
+            SDL_Log("Replay diverged from tick %lld of %u", (long long)replayDivergedAt, replayTickCount);
+        }
+    }
+
+    free(replayRuns);
+    free(replayHashes);
+    replayRuns = NULL;
+    replayHashes = NULL;
+    replayMode = REPLAY_OFF;
+}
+
+
+// Headless runs press random keys unless they replay a recording, holding each
+// combination for up to a second. Mostly right, so the player gets somewhere
+Uint8 randomInput() {
+    static Uint8 input = 0;
+    static int hold = 0;
+
+    if (hold-- > 0) return input;
+
+    inputRandom ^= inputRandom << 13;
+    inputRandom ^= inputRandom >> 17;
+    inputRandom ^= inputRandom << 5;
+
+    switch (inputRandom & 3) {
+        case 0: input = 0; break;
+        case 1: input = INPUT_LEFT; break;
+        default: input = INPUT_RIGHT; break;
+    }
+    if (inputRandom & 4) input |= INPUT_JUMP;
+    hold = (inputRandom >> 8) % TICK_RATE;
+    return input;
+}
+
+// Tick as fast as the CPU allows with nothing drawn, then report the rate and where it ended
+void runHeadless(World* w) {
+    const Player* player = &w->player;
+    Uint64 limit = headlessTicks;
+    if (limit == 0) limit = replayMode == REPLAY_PLAYING ? SDL_MAX_UINT64 : HEADLESS_DEFAULT_TICKS;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint64 ticks = 0;
+    Uint8 input;
+
+    while (ticks < limit && nextInput(&input)) {
+        simulateTick(w, input);
+        finishTick(input, w);
+        ticks++;
+    }
+
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    SDL_Log("Headless: %llu ticks in %.2f s, %.0f ticks/s", (unsigned long long)ticks, seconds,
+            seconds > 0 ? ticks / seconds : 0.0);
+    SDL_Log("Headless: player at (%.1f, %.1f), score %d, %d wins, %d deaths, state %08x",
+            player->x, player->y, w->score, w->wins, w->deaths, hashState(w));
+}
+
+// One fixed step of the simulation
+void simulateTick(World* w, Uint8 input) {
+    Player* player = &w->player;
+    resetArena(&scratch);
+
+    // Rewind on the tick the key goes down. It's input like any other, so replays rewind too
+    bool rewind = (input & INPUT_REWIND) && !(w->lastInput & INPUT_REWIND);
+    w->lastInput = input;
+    if (rewind && rewindWorld(w)) return;
+
+    // Between lives the world stands still, input is ignored until the reset
+    if (w->state != GAME_PLAYING) {
+        savePreviousPositions(w);
+        updateGameState(w);
+        return;
+    }
+    w->tick++;
+    if (w->rewind && w->tick % REWIND_INTERVAL == 0) pushRewind(w);
+
+    // The camera follows the player, so stream around where it is this tick
+    PROFILE_BEGIN(updateCamera);
+    updateCamera(&w->camera, player);
+    PROFILE_END(updateCamera);
+    PROFILE_BEGIN(updateStreaming);
+    updateStreaming(w);
+    PROFILE_END(updateStreaming);
+
+    savePreviousPositions(w);
+
+    PROFILE_BEGIN(handleInput);
+    handleInput(player, input);
+    PROFILE_END(handleInput);
+
+    PROFILE_BEGIN(updatePhysics);
+    updatePhysics(w);
+    syncEnemyBodies(w);
+    PROFILE_END(updatePhysics);
+
+    PROFILE_BEGIN(checkCollisions);
+    checkTerrainCollisions(w);
+    if (w->state == GAME_PLAYING) checkCollisions(w);
+    checkEnemyEnemyCollisions(w);
+    PROFILE_END(checkCollisions);
+    PROFILE_BEGIN(checkEnemyCollisions);
+    if (w->state == GAME_PLAYING) checkEnemyCollisions(w);
+    if (w->state == GAME_PLAYING) checkBulletCollisions(w);
+    PROFILE_END(checkEnemyCollisions);
+    if (w->state == GAME_PLAYING) checkGoalCollision(w);
+    if (w->state == GAME_PLAYING) checkFallDetection(w);
+}
+
+
+// Copy out everything renderScene draws: the ground, platforms, coins and enemies of the
+// active chunks, the bullets and the player
+void takeSnapshot(const World* w, RenderSnapshot* s) {
+    s->tick = w->tick;
+    s->player = w->player;
+    s->score = w->score;
+    s->state = w->state;
+    s->message = w->message;
+    s->messageColor = w->messageColor;
+    s->groundCount = s->platformCount = s->coinCount = s->enemyCount = s->bulletCount = 0;
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int slotIndex = w->activeSlots[a];
+        const ChunkSlot* slot = &w->slots[slotIndex];
+        int columns = level.chunks[slot->chunk].groundColumns;
+
+        s->groundChunk[s->groundCount] = slot->chunk;
+        memset(s->ground[s->groundCount], 0, sizeof(s->ground[0]));
+        memcpy(s->ground[s->groundCount], slot->payload + slot->groundOffset, columns);
+        s->groundCount++;
+
+        memcpy(s->platforms + s->platformCount, w->platforms + slotIndex * CHUNK_MAX_PLATFORMS,
+               slot->platformCount * sizeof(LevelPlatform));
+        s->platformCount += slot->platformCount;
+
+        int first = slotIndex * CHUNK_MAX_COINS;
+        for (int i = first; i < first + slot->coinCount; i++) {
+            if (w->coins.collected[i]) continue;
+            s->coins[s->coinCount++] = (SnapshotSprite){ w->coins.x[i], w->coins.y[i], w->coins.x[i], w->coins.y[i],
+                                                         w->coins.w[i], w->coins.h[i], w->coins.animStart[i], false, 0 };
+        }
+
+        first = slotIndex * CHUNK_MAX_ENEMIES;
+        for (int i = first; i < first + slot->enemyCount; i++) {
+            s->enemies[s->enemyCount++] = (SnapshotSprite){ w->enemies.x[i], w->enemies.y[i],
+                                                            w->enemies.prevX[i], w->enemies.prevY[i],
+                                                            w->enemies.w[i], w->enemies.h[i],
+                                                            w->enemies.animStart[i], w->enemies.facingRight[i],
+                                                            w->enemies.type[i] };
+        }
+    }
+
+    const BulletStore* b = &w->bullets;
+    for (int i = 0; i < b->count; i++) {
+        s->bullets[s->bulletCount++] = (SnapshotSprite){ b->x[i], b->y[i], b->prevX[i], b->y[i],
+                                                         BULLET_SIZE, BULLET_SIZE, 0, b->vx[i] > 0, b->type[i] };
+    }
+}
+
+static bool snapshotGroundAt(const RenderSnapshot* s, int x) {
+    if (x < 0) return false;
+
+    int chunk = x / CHUNK_WIDTH;
+    for (int g = 0; g < s->groundCount; g++) {
+        if (s->groundChunk[g] == chunk) return s->ground[g][(x - chunk * CHUNK_WIDTH) / GROUND_TILE_SIZE] != 0;
+    }
+    return false;
+}
+
+// Sim thread: hand the filled back buffer over and take the old middle to fill next
+void publishSnapshot() {
+    simBuffer = SDL_AtomicSet(&snapshotMiddle, simBuffer | SNAPSHOT_FRESH) & ~SNAPSHOT_FRESH;
+}
+
+// Main thread: the newest published snapshot, or the one drawn last if nothing newer came
+const RenderSnapshot* latestSnapshot() {
+    if (SDL_AtomicGet(&snapshotMiddle) & SNAPSHOT_FRESH) {
+        drawBuffer = SDL_AtomicSet(&snapshotMiddle, drawBuffer) & ~SNAPSHOT_FRESH;
+    }
+    return &snapshots[drawBuffer];
+}
+
+// Tick the world at TICK_RATE, catching up like a frame loop would, and publish after
+// every batch of ticks
+static int simulate(void* data) {
+    World* w = data;
+    PROFILE_THREAD("sim");
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 lastCounter = SDL_GetPerformanceCounter();
+    double accumulator = 0.0;
+
+    while (SDL_AtomicGet(&simRunning)) {
+        Uint64 counter = SDL_GetPerformanceCounter();
+        double frameTime = (double)(counter - lastCounter) / frequency;
+        lastCounter = counter;
+
+        if (frameTime > MAX_FRAME_TIME) frameTime = MAX_FRAME_TIME;
+        accumulator += frameTime;
+
+        // Run as many fixed ticks as the elapsed time needs, catching up if we fell behind
+        int ticks = 0;
+        while (accumulator >= TICK_DT && ticks < MAX_TICKS_PER_FRAME) {
+            Uint8 input;
+            if (!nextInput(&input)) {
+                SDL_AtomicSet(&simFinished, 1);
+                freeArena(&scratch);
+                return 0;
+            }
+
+            PROFILE_BEGIN(simulateTick);
+            simulateTick(w, input);
+            PROFILE_END(simulateTick);
+            finishTick(input, w);
+            accumulator -= TICK_DT;
+            ticks++;
+        }
+
+        // Too far behind to catch up, drop the rest instead of spiralling
+        if (ticks == MAX_TICKS_PER_FRAME && accumulator >= TICK_DT) {
+            accumulator = 0.0;
+        }
+
+        if (ticks > 0) {
+            PROFILE_BEGIN(takeSnapshot);
+            RenderSnapshot* s = &snapshots[simBuffer];
+            takeSnapshot(w, s);
+            s->tickCounter = counter - (Uint64)(accumulator * frequency);
+            publishSnapshot();
+            PROFILE_END(takeSnapshot);
+        }
+
+        // Sleep until the next tick is due
+        SDL_Delay((Uint32)((TICK_DT - accumulator) * 1000.0));
+    }
+    freeArena(&scratch);
+    return 0;
+}
+
+// The main thread must not touch the world again until stopSimulation
+bool startSimulation(World* w) {
+    simBuffer = 0;
+    drawBuffer = 1;
+    SDL_AtomicSet(&snapshotMiddle, 2);
+    SDL_AtomicSet(&simFinished, 0);
+    SDL_AtomicSet(&simRunning, 1);
+
+    // Something to draw before the first tick is published
+    takeSnapshot(w, &snapshots[drawBuffer]);
+    snapshots[drawBuffer].tickCounter = SDL_GetPerformanceCounter();
+
+    simThread = SDL_CreateThread(simulate, "sim", w);
+    if (!simThread) {
+        printf("Failed to start the simulation thread! SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+void stopSimulation() {
+    if (!simThread) return;
+
+    SDL_AtomicSet(&simRunning, 0);
+    SDL_WaitThread(simThread, NULL);
+    simThread = NULL;
+}
+
+
+void updateCamera(SDL_Rect* camera, const Player* player) {
+    camera->x = (int)(player->x + player->w / 2) - WINDOW_WIDTH / 2;
+    camera->y = (int)(player->y + player->h / 2) - WINDOW_HEIGHT / 2;
+    
+    
+    if (camera->x < 0) camera->x = 0;
+    if (camera->y < 0) camera->y = 0;
+    if (camera->x > level.header->width - WINDOW_WIDTH) camera->x = level.header->width - WINDOW_WIDTH;
+}
+
+
+// alpha is how far we are between the last two ticks (0..1)
+void renderScene(const RenderSnapshot* s, float alpha) {
+    Player player = s->player;
+    SDL_Rect camera = { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
+
+    // Draw the player where it is between the previous and current tick
+    player.x = player.prevX + (player.x - player.prevX) * alpha;
+    player.y = player.prevY + (player.y - player.prevY) * alpha;
+    updateCamera(&camera, &player);
+
+    drawCalls = 0;
+
+    // Only re-layout the HUD text when the score actually changes
+    if (s->score != scoreLabelValue) {
+        if (damageTracking) addDamage(labelBounds(&scoreLabel));
+        const char* scoreText = arenaPrintf(&scratch, "Score: %d", s->score);
+        setLabel(&scoreLabel, hudFont, scoreText, 10, 10, (SDL_Color){ 255, 255, 255, 255 });
+        scoreLabelValue = s->score;
+        if (damageTracking) addDamage(labelBounds(&scoreLabel));
+    }
+
+    // Out of scratch the queue takes nothing, the frame is drawn without its moving sprites
+    RenderCommand* queued = ARENA_ARRAY(&scratch, RenderCommand, MAX_RENDER_COMMANDS);
+    RenderQueue queue = { queued, 0, queued ? MAX_RENDER_COMMANDS : 0, { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT } };
+    queueScene(s, alpha, &camera, &queue);
+
+    RenderCommand* commands = sceneCommands[sceneFrame];
+    int commandCount = sortRenderQueue(&queue, commands);
+
+    if (damageTracking) {
+        renderDamagedScene(s, &camera, commands, commandCount);
+    } else {
+        SDL_RenderClear(renderer);
+        drawStaticLayer(s, &camera);
+        drawRenderCommands(commands, commandCount, NULL);
+        drawLabel(&scoreLabel);
+        flushBatch();
+    }
+    sceneCommandCount[sceneFrame] = commandCount;
+    sceneFrame ^= 1;
+
+    if (s->state != GAME_PLAYING) drawMessage(s);
+
+#ifdef PROFILE
+    drawProfileOverlay();
+#endif
+
+    PROFILE_BEGIN(present);
+    SDL_RenderPresent(renderer);
+    PROFILE_END(present);
+}
+
+// Queue one sprite at dst on screen, unless it's outside the queue's bounds or its sheet
+// isn't on the atlas yet. src is relative to the sprite sheet, empty for the whole sheet
+void pushSprite(RenderQueue* queue, RenderLayer layer, const Sprite* sprite, SDL_Rect src, SDL_Rect dst, bool flip) {
+    if (!sprite->page || queue->count == queue->capacity) return;
+    if (!SDL_HasIntersection(&dst, &queue->bounds)) return;
+
+    Uint16 key = (Uint16)(layer << 8 | (sprite->page - atlasPages));
+    queue->commands[queue->count++] = (RenderCommand){ key, flip, sprite, src, dst };
+}
+
+// Stable LSD radix sort of the queue into sorted, a byte of the key per pass: atlas page, then
+// layer. Returns how many commands are in sorted, none if there's no scratch for the first pass
+int sortRenderQueue(const RenderQueue* queue, RenderCommand* sorted) {
+    if (queue->count == 0) return 0;
+    RenderCommand* byPage = ARENA_ARRAY(&scratch, RenderCommand, queue->count);
+    if (!byPage) return 0;
+    const RenderCommand* in = queue->commands;
+    RenderCommand* out = byPage;
+
+    for (int shift = 0; shift <= 8; shift += 8) {
+        int offsets[256] = { 0 };
+        for (int i = 0; i < queue->count; i++) offsets[(in[i].key >> shift) & 0xff]++;
+
+        int total = 0;
+        for (int b = 0; b < 256; b++) {
+            int n = offsets[b];
+            offsets[b] = total;
+            total += n;
+        }
+
+        for (int i = 0; i < queue->count; i++) out[offsets[(in[i].key >> shift) & 0xff]++] = in[i];
+
+        in = out;
+        out = sorted;
+    }
+    return queue->count;
+}
+
+// Everything that moves or animates, at its position on screen this frame
+void queueScene(const RenderSnapshot* s, float alpha, const SDL_Rect* camera, RenderQueue* queue) {
+    //player
+    const Player* player = &s->player;
+    float playerX = player->prevX + (player->x - player->prevX) * alpha;
+    float playerY = player->prevY + (player->y - player->prevY) * alpha;
+    pushSprite(queue, LAYER_PLAYER, &playerSprite, clipFrame(&clips[CLIP_PLAYER_RUN], s->tick, player->animStart),
+               (SDL_Rect){ (int)(playerX - camera->x), (int)(playerY - camera->y), (int)player->w, (int)player->h },
+               player->facingLeft);
+
+    
+    for (int i = 0; i < s->coinCount; i++) {
+        const SnapshotSprite* coin = &s->coins[i];
+        pushSprite(queue, LAYER_PICKUPS, &coinSprite, clipFrame(&clips[CLIP_COIN], s->tick, coin->animStart),
+                   (SDL_Rect){ (int)(coin->x - camera->x), (int)(coin->y - camera->y), (int)coin->w, (int)coin->h },
+                   false);
+    }
+
+    // enemy animation
+    for (int i = 0; i < s->enemyCount; i++) {
+        const SnapshotSprite* enemy = &s->enemies[i];
+        float enemyX = enemy->prevX + (enemy->x - enemy->prevX) * alpha;
+        float enemyY = enemy->prevY + (enemy->y - enemy->prevY) * alpha;
+        pushSprite(queue, LAYER_ENEMIES, &enemySprites[enemy->type], clipFrame(&enemyClips[enemy->type], s->tick, enemy->animStart),
+                   (SDL_Rect){ (int)(enemyX - camera->x), (int)(enemyY - camera->y), (int)enemy->w, (int)enemy->h },
+                   enemy->flip);
+    }
+
+    for (int i = 0; i < s->bulletCount; i++) {
+        const SnapshotSprite* bullet = &s->bullets[i];
+        float bulletX = bullet->prevX + (bullet->x - bullet->prevX) * alpha;
+        pushSprite(queue, LAYER_BULLETS, &bulletSprites[bullet->type], (SDL_Rect){ 0, 0, 0, 0 },
+                   (SDL_Rect){ (int)(bulletX - camera->x), (int)(bullet->y - camera->y), (int)bullet->w, (int)bullet->h },
+                   bullet->flip);
+    }
+
+   
+    const LevelRect* goal = level.goal;
+    pushSprite(queue, LAYER_SCENERY, &goalSprite, (SDL_Rect){ 0, 0, 0, 0 },
+               (SDL_Rect){ goal->x - camera->x, goal->y - camera->y, goal->w, goal->h }, false);
+}
+
+// The background and terrain, which only change when the camera moves or chunks stream in
+void drawStaticLayer(const RenderSnapshot* s, const SDL_Rect* camera) {
+    drawSprite(&bgSprite, NULL, 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT, false);
+    terrainFrame++;
+
+    int first = camera->x / STRIP_WIDTH;
+    int last = (camera->x + WINDOW_WIDTH - 1) / STRIP_WIDTH;
+    for (int i = first; i <= last; i++) {
+        TerrainStrip* strip = terrainStrip(s, i);
+        if (!strip) {
+            drawTerrainTiles(s, camera, i * STRIP_WIDTH, (i + 1) * STRIP_WIDTH);
+            continue;
+        }
+
+        // Not batched, so everything queued has to go out first to keep the order
+        flushBatch();
+        SDL_Rect dst = { i * STRIP_WIDTH - camera->x, -camera->y, STRIP_WIDTH, level.header->height };
+        SDL_RenderCopy(renderer, strip->texture, NULL, &dst);
+        drawCalls++;
+    }
+}
+
+// Ground columns and platform tiles between world x fromX and toX
+void drawTerrainTiles(const RenderSnapshot* s, const SDL_Rect* camera, int fromX, int toX) {
+    SDL_Rect groundSrcRect = { 0, 0, 32, 32 }; // The grass+dirt tile
+    SDL_Rect dirtSrcRect = { 0, 16, 32, 16 };  // Just the dirt part
+
+    
+    int groundY = level.table->groundY;
+    int startX = fromX / GROUND_TILE_SIZE;
+    int endX = (toX - 1) / GROUND_TILE_SIZE;
+
+    //ground
+    for (int i = startX; i <= endX; i++) {
+        int groundX = i * GROUND_TILE_SIZE;
+        
+        if (snapshotGroundAt(s, groundX)) {
+            drawSprite(&terrainSprite, &groundSrcRect,
+                       groundX - camera->x, groundY - camera->y, GROUND_TILE_SIZE, 32, false);
+            
+            // dirt tiles
+            for (int j = 1; j < (GROUND_HEIGHT / 16); j++) {
+                drawSprite(&terrainSprite, &dirtSrcRect,
+                           groundX - camera->x, groundY + (j * 16) - camera->y, GROUND_TILE_SIZE, 16, false);
+            }
+        }
+    }
+
+    
+    SDL_Rect platformSrcRect = { 96, 0, 16, 16 }; 
+
+    
+    for (int i = 0; i < s->platformCount; i++) {
+        const LevelPlatform* plat = &s->platforms[i];
+        if (!(plat->flags & LEVEL_PLATFORM_ACTIVE)) continue;
+        if (plat->x >= toX || plat->x + plat->w <= fromX) continue;
+
+        // Hazards are the same tiles in red
+        SDL_Color tint = (plat->flags & LEVEL_PLATFORM_HAZARD) ? (SDL_Color){ 255, 80, 80, 255 } : (SDL_Color){ 255, 255, 255, 255 };
+
+        int tilesNeeded = plat->w / 16;
+        for (int j = 0; j < tilesNeeded; j++) {
+            drawTintedSprite(&platformSprite, &platformSrcRect,
+                             plat->x - camera->x + (j * 16), plat->y - camera->y,
+                             16, plat->h, false, tint);
+        }
+    }
+}
+
+// The strip's texture with its terrain up to date, or NULL if strips can't be had. The key
+// covers the chunk before the strip as well, its platforms can reach into it, and the sheets
+// uploaded so far
+TerrainStrip* terrainStrip(const RenderSnapshot* s, int index) {
+    if (terrainStripsFailed) return NULL;
+
+    int firstChunk = index * STRIP_WIDTH / CHUNK_WIDTH - 1;
+    int lastChunk = ((index + 1) * STRIP_WIDTH - 1) / CHUNK_WIDTH;
+    Uint32 key = 0;
+    for (int g = 0; g < s->groundCount; g++) {
+        int chunk = s->groundChunk[g];
+        if (chunk >= firstChunk && chunk <= lastChunk) key |= 1u << (chunk - firstChunk);
+    }
+    key |= (Uint32)assetsUploaded << 8;
+
+    TerrainStrip* strip = NULL;
+    for (int i = 0; i < MAX_TERRAIN_STRIPS; i++) {
+        if (terrainStrips[i].index == index && terrainStrips[i].texture) {
+            strip = &terrainStrips[i];
+            break;
+        }
+        if (!strip || terrainStrips[i].lastUsed < strip->lastUsed) strip = &terrainStrips[i];
+    }
+    if (strip->index != index) {
+        strip->index = index;
+        strip->valid = false;
+    }
+    strip->lastUsed = terrainFrame;
+    if (strip->valid && strip->key == key) return strip;
+
+    if (!strip->texture) {
+        strip->texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+                                           STRIP_WIDTH, level.header->height);
+        if (!strip->texture) {
+            SDL_Log("Drawing terrain tile by tile, strip textures failed: %s", SDL_GetError());
+            freeTerrainStrips();
+            terrainStripsFailed = true;
+            return NULL;
+        }
+
+        // Tiles are blended onto a clear strip, leaving their colour multiplied by their alpha.
+        // Without custom blend modes (the software renderer) edges come out slightly darker
+        terrainBlendMode = SDL_ComposeCustomBlendMode(SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+                                                      SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+        if (SDL_SetTextureBlendMode(strip->texture, terrainBlendMode) < 0) {
+            terrainBlendMode = SDL_BLENDMODE_BLEND;
+            SDL_SetTextureBlendMode(strip->texture, terrainBlendMode);
+        }
+    }
+
+    // Bake it, from whatever was being drawn into
+    flushBatch();
+    SDL_Texture* target = SDL_GetRenderTarget(renderer);
+    SDL_SetRenderTarget(renderer, strip->texture);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+
+    SDL_Rect camera = { index * STRIP_WIDTH, 0, STRIP_WIDTH, level.header->height };
+    drawTerrainTiles(s, &camera, camera.x, camera.x + STRIP_WIDTH);
+    flushBatch();
+
+    SDL_SetRenderTarget(renderer, target);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    strip->key = key;
+    strip->valid = true;
+    return strip;
 }
 
-// Load media (images)
-bool loadMedia() {
-    // Load player texture
-    playerTexture = loadTexture("assets/Pixel Adevnture/Main Characters/Virtual Guy/Run (32x32).png");
-    if (!playerTexture) {
-        printf("Failed to load player texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
-    }
-    
-    goalTexture = loadTexture("assets/Pixel Adevnture/Items/Checkpoints/End/End (Idle).png");
-    if (!goalTexture) {
-        printf("Failed to load Flag texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
+// Strips over world x to x + w are baked again the next time they're drawn
+void invalidateTerrain(int x, int w) {
+    for (int i = 0; i < MAX_TERRAIN_STRIPS; i++) {
+        int stripX = terrainStrips[i].index * STRIP_WIDTH;
+        if (stripX < x + w && stripX + STRIP_WIDTH > x) terrainStrips[i].valid = false;
     }
+}
 
-    bgTexture = loadTexture("assets/Pixel Adevnture/Background/Blue.png");
-    if (!bgTexture) {
-        printf("Failed to load Background texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
+void freeTerrainStrips() {
+    for (int i = 0; i < MAX_TERRAIN_STRIPS; i++) {
+        if (terrainStrips[i].texture) SDL_DestroyTexture(terrainStrips[i].texture);
+        terrainStrips[i] = (TerrainStrip){ .index = -1 };
     }
+}
 
-    // Load terrain texture
-    terrainTexture = loadTexture("assets/Terrain (16x16).png");
-    if (!terrainTexture) {
-        printf("Failed to load terrain texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
-    }
+// Commands that miss clip are skipped, NULL draws them all
+void drawRenderCommands(const RenderCommand* commands, int count, const SDL_Rect* clip) {
+    for (int i = 0; i < count; i++) {
+        const RenderCommand* command = &commands[i];
+        if (clip && !SDL_HasIntersection(&command->dst, clip)) continue;
 
-    // Load enemy texture (with animation frames)
-    enemyTexture = loadTexture("assets/Pixel Adevnture/Enemies/BlueBird/Flying (32x32).png");
-    if (!enemyTexture) {
-        printf("Failed to load enemy texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
+        drawSprite(command->sprite, command->src.w > 0 ? &command->src : NULL,
+                   command->dst.x, command->dst.y, command->dst.w, command->dst.h, command->flip);
     }
+}
 
-    // Load coin texture
-    coinTexture = loadTexture("assets/Pixel Adevnture/Items/Fruits/Apple.png");
-    if (!coinTexture) {
-        printf("Failed to load coin texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
+SDL_Rect labelBounds(const TextLabel* label) {
+    if (!label->font || label->quadCount == 0) return (SDL_Rect){ 0, 0, 0, 0 };
+    return (SDL_Rect){ label->x, label->y, measureText(label->font, label->text), label->font->height };
+}
+
+// Damage that overlaps a rectangle already queued is merged into it. Past MAX_DAMAGE_RECTS
+// the frame is redrawn whole
+void addDamage(SDL_Rect rect) {
+    SDL_Rect screen = { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
+    if (damageFull || !SDL_IntersectRect(&rect, &screen, &rect)) return;
+
+    for (int i = 0; i < damageRectCount; i++) {
+        if (SDL_HasIntersection(&damageRects[i], &rect)) {
+            SDL_UnionRect(&damageRects[i], &rect, &damageRects[i]);
+            return;
+        }
     }
-    
-    // Load platform texture
-    platformTexture = loadTexture("assets/Pixel Adevnture/Terrain/Terrain (16x16).png");
-    if (!platformTexture) {
-        printf("Failed to load platform texture! SDL_image Error: %s\n", IMG_GetError());
-        return false;
+
+    if (damageRectCount == MAX_DAMAGE_RECTS) {
+        damageFull = true;
+        return;
     }
+    damageRects[damageRectCount++] = rect;
+}
 
-    return true;
+static bool sameRenderCommand(const RenderCommand* a, const RenderCommand* b) {
+    return a->sprite == b->sprite && a->flip == b->flip &&
+           SDL_RectEquals(&a->src, &b->src) && SDL_RectEquals(&a->dst, &b->dst);
 }
 
+// Brings sceneTexture up to date with this frame and copies it to the window
+void renderDamagedScene(const RenderSnapshot* s, const SDL_Rect* camera, const RenderCommand* commands, int count) {
+    SDL_Rect screen = { 0, 0, WINDOW_WIDTH, WINDOW_HEIGHT };
 
-bool initSDL() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        SDL_Log("SDL could not initialize! SDL_Error: %s", SDL_GetError());
-        return false;
-    }
+    // Sheets that finish uploading after the first frame can show up in either layer
+    Uint32 key = hashBytes(2166136261u, &camera->x, sizeof(camera->x));
+    key = hashBytes(key, &camera->y, sizeof(camera->y));
+    key = hashBytes(key, &s->groundCount, sizeof(s->groundCount));
+    key = hashBytes(key, s->groundChunk, s->groundCount * sizeof(s->groundChunk[0]));
+    key = hashBytes(key, &s->platformCount, sizeof(s->platformCount));
+    key = hashBytes(key, &assetsUploaded, sizeof(assetsUploaded));
 
-    int imgFlags = IMG_INIT_PNG;
-    if (!(IMG_Init(imgFlags) & imgFlags)) {
-        SDL_Log("SDL_image could not initialize! SDL_image Error: %s", IMG_GetError());
-        return false;
+    if (!sceneValid || key != staticKey) {
+        SDL_SetRenderTarget(renderer, staticTexture);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        drawStaticLayer(s, camera);
+        flushBatch();
+        staticKey = key;
+        damageFull = true;
+    } else {
+        // A sprite that moved, animated, appeared or went away is redrawn where it was and where it is
+        const RenderCommand* before = sceneCommands[sceneFrame ^ 1];
+        int beforeCount = sceneCommandCount[sceneFrame ^ 1];
+        int common = beforeCount < count ? beforeCount : count;
+
+        for (int i = 0; i < common && !damageFull; i++) {
+            if (!sameRenderCommand(&before[i], &commands[i])) {
+                addDamage(before[i].dst);
+                addDamage(commands[i].dst);
+            }
+        }
+        for (int i = common; i < beforeCount; i++) addDamage(before[i].dst);
+        for (int i = common; i < count; i++) addDamage(commands[i].dst);
     }
 
-    if (TTF_Init() < 0) {
-        SDL_Log("TTF Init failed: %s", TTF_GetError());
-        return false;
+    if (damageFull) {
+        damageRects[0] = screen;
+        damageRectCount = 1;
     }
 
-    font = TTF_OpenFont("fonts/TTF/ARIAL.TTF", 24);
-    if (!font) {
-        SDL_Log("Failed to load font: %s", TTF_GetError());
-        return false;
+    SDL_SetRenderTarget(renderer, sceneTexture);
+    for (int i = 0; i < damageRectCount; i++) {
+        const SDL_Rect* rect = &damageRects[i];
+        SDL_RenderSetClipRect(renderer, rect);
+        SDL_RenderCopy(renderer, staticTexture, rect, rect);
+        drawCalls++;
+        drawRenderCommands(commands, count, rect);
+        drawLabel(&scoreLabel);
+        flushBatch();
     }
+    SDL_RenderSetClipRect(renderer, NULL);
+    SDL_SetRenderTarget(renderer, NULL);
 
-    window = SDL_CreateWindow(
-        "2D Platformer",
-        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        WINDOW_WIDTH, WINDOW_HEIGHT,
-        SDL_WINDOW_RESIZABLE
-    );
+    damageRectCount = 0;
+    damageFull = false;
+    sceneValid = true;
 
-    if (!window) {
-        SDL_Log("Window could not be created! SDL_Error: %s", SDL_GetError());
-        return false;
-    }
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, sceneTexture, NULL, &screen);
+    drawCalls++;
+}
 
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-    if (!renderer) {
-        SDL_Log("Renderer could not be created! SDL_Error: %s", SDL_GetError());
-        return false;
+#ifdef PROFILE
+// Give the calling thread its own ring. Threads that never register aren't timed
+void profileRegisterThread(const char* name) {
+    int index = SDL_AtomicAdd(&profileRingCount, 1);
+    if (index >= MAX_PROFILE_THREADS) {
+        printf("Profiler: no ring left for thread %s\n", name);
+        return;
     }
 
-    return true;
+    profileRings[index].threadName = name;
+    profileRing = &profileRings[index];
 }
 
+// Close the event for stage that started at start on this thread's ring
+void profileRecord(const char* name, Uint64 start) {
+    ProfileRing* ring = profileRing;
+    if (!ring) return;
 
-void cleanupSDL() {
-    SDL_DestroyTexture(terrainTexture);
-    SDL_DestroyTexture(playerTexture);
-    SDL_DestroyTexture(enemyTexture);
-    SDL_DestroyTexture(coinTexture);
-    SDL_DestroyTexture(platformTexture);
-    terrainTexture = NULL;
-    playerTexture = NULL;
-    enemyTexture = NULL;
-    coinTexture = NULL;
-    platformTexture = NULL;
-
-    TTF_CloseFont(font);
-    TTF_Quit();
-    IMG_Quit();
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
+    unsigned head = (unsigned)SDL_AtomicGet(&ring->head);
+    if (head - (unsigned)SDL_AtomicGet(&ring->tail) == PROFILE_RING_SIZE) {
+        SDL_AtomicAdd(&ring->dropped, 1);
+        return;
+    }
+
+    ring->events[head & (PROFILE_RING_SIZE - 1)] = (ProfileEvent){ name, start, SDL_GetPerformanceCounter() };
+    SDL_AtomicSet(&ring->head, (int)(head + 1));     // publishes the event to the main thread
 }
 
+static double profileMs(Uint64 ticks) {
+    return (double)ticks * 1000.0 / SDL_GetPerformanceFrequency();
+}
 
-void handleInput(Player* player, bool* running) {
-    SDL_Event event;
-    const float moveSpeed = 5.0f;
-    const float jumpStrength = -12.0f;
+// Main thread, once per frame: drain every ring into the stage totals and the capture
+void profileEndFrame(Uint64 frameStart) {
+    profileRecord("frame", frameStart);
+    profileFrameMs[profileFrameCount % PROFILE_HISTORY] = (float)profileMs(SDL_GetPerformanceCounter() - frameStart);
+    profileFrameCount++;
 
-    while (SDL_PollEvent(&event)) {
-        if (event.type == SDL_QUIT) {
-            *running = false;
+    for (int s = 0; s < profileStageCount; s++) profileStageMs[s] = 0.0;
+
+    int threads = SDL_AtomicGet(&profileRingCount);
+    if (threads > MAX_PROFILE_THREADS) threads = MAX_PROFILE_THREADS;
+
+    for (int t = 0; t < threads; t++) {
+        ProfileRing* ring = &profileRings[t];
+        unsigned tail = (unsigned)SDL_AtomicGet(&ring->tail);
+        unsigned head = (unsigned)SDL_AtomicGet(&ring->head);
+
+        // The overlay shows the frame's stages, which the main and sim threads split between them
+        bool staged = ring == profileRing || strcmp(ring->threadName, "sim") == 0;
+
+        for (; tail != head; tail++) {
+            const ProfileEvent* e = &ring->events[tail & (PROFILE_RING_SIZE - 1)];
+
+            if (staged) {
+                int s = 0;
+                while (s < profileStageCount && strcmp(profileStageNames[s], e->name) != 0) s++;
+                if (s == profileStageCount && s < PROFILE_MAX_STAGES) {
+                    profileStageNames[s] = e->name;
+                    profileStageMs[s] = 0.0;
+                    profileStageCount++;
+                }
+                if (s < profileStageCount) profileStageMs[s] += profileMs(e->end - e->start);
+            }
+
+            if (profileCaptureFramesLeft > 0 && profileCaptureCount < PROFILE_CAPTURE_EVENTS) {
+                profileCapture[profileCaptureCount++] = (CapturedEvent){ *e, t };
+            }
         }
+        SDL_AtomicSet(&ring->tail, (int)tail);
     }
 
-    const Uint8 *keys = SDL_GetKeyboardState(NULL);
-    if (keys[SDL_SCANCODE_LEFT] || keys[SDL_SCANCODE_A]) {
-        player->vx = -moveSpeed;
-        player->facingLeft = true;
-    } else if (keys[SDL_SCANCODE_RIGHT] || keys[SDL_SCANCODE_D]) {
-        player->vx = moveSpeed;
-        player->facingLeft = false;
-    } else {
-        player->vx = 0;
+    if (profileCaptureFramesLeft > 0 && --profileCaptureFramesLeft == 0) {
+        writeProfileTrace(PROFILE_TRACE_PATH);
     }
+}
 
-    if ((keys[SDL_SCANCODE_UP] || keys[SDL_SCANCODE_SPACE]) && player->onGround) {
-        player->vy = jumpStrength;
-        player->onGround = false;
+void startProfileCapture() {
+    if (profileCaptureFramesLeft > 0) return;
+
+    if (!profileCapture) profileCapture = malloc(PROFILE_CAPTURE_EVENTS * sizeof(CapturedEvent));
+    if (!profileCapture) {
+        printf("Profiler: out of memory for a capture\n");
+        return;
     }
-}
 
+    profileCaptureCount = 0;
+    profileCaptureFramesLeft = PROFILE_CAPTURE_FRAMES;
+    SDL_Log("Profiler: capturing %d frames to %s", PROFILE_CAPTURE_FRAMES, PROFILE_TRACE_PATH);
+}
 
-void updatePhysics(Player* player) {
-    const float gravity = 0.5f;
+// Chrome trace_event JSON, open it in Perfetto or chrome://tracing
+bool writeProfileTrace(const char* path) {
+    profileCaptureFramesLeft = 0;
 
-    if (!player->onGround) { //gravity
-        player->vy += gravity;
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Profiler: unable to write %s\n", path);
+        return false;
     }
 
-    player->x += player->vx;
-    player->y += player->vy;
-
+    double usPerTick = 1000000.0 / SDL_GetPerformanceFrequency();
+    bool named[MAX_PROFILE_THREADS] = { false };
+    const char* separator = "";
 
-    player->onGround = false;
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int i = 0; i < profileCaptureCount; i++) {
+        const CapturedEvent* c = &profileCapture[i];
 
-   
-    if (player->vx != 0) {   //player
-        player->frameTimer++;
-        if (player->frameTimer >= player->frameDelay) {
-            player->frame++;
-            if (player->frame >= player->totalFrames) {
-                player->frame = 0;
-            }
-            player->frameTimer = 0;
+        // A thread only has events once its name is set, so naming it here is safe
+        if (!named[c->thread]) {
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    separator, c->thread + 1, profileRings[c->thread].threadName);
+            separator = ",\n";
+            named[c->thread] = true;
         }
-    } else {
-        player->frame = 0;  
+
+        fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                separator, c->event.name, c->thread + 1,
+                (double)(c->event.start - startupCounter) * usPerTick,
+                (double)(c->event.end - c->event.start) * usPerTick);
+        separator = ",\n";
     }
+    fprintf(file, "\n]}\n");
+    fclose(file);
 
-    
-    for (int i = 0; i < MAX_ENEMIES; i++) {  //enemy
-        enemies[i].x += enemies[i].vx;
+    int dropped = 0;
+    for (int t = 0; t < MAX_PROFILE_THREADS; t++) dropped += SDL_AtomicGet(&profileRings[t].dropped);
+    SDL_Log("Profiler: wrote %d events to %s (%d dropped)", profileCaptureCount, path, dropped);
+    profileCaptureCount = 0;
+    return true;
+}
 
-        if (enemies[i].vx < 0) {
-            enemies[i].facingLeft = false;
-        } else if (enemies[i].vx > 0) {
-            enemies[i].facingLeft = true;
-        }
+static int compareFloats(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
 
+// Frame time graph with a line at the tick budget, percentiles, draw calls and stage times
+void drawProfileOverlay() {
+    if (!profileOverlay || profileFrameCount == 0) return;
 
-        enemies[i].frameTimer++;
-        if (enemies[i].frameTimer >= enemies[i].frameDelay) {
-            enemies[i].frame++;
-            if (enemies[i].frame >= enemies[i].totalFrames) {
-                enemies[i].frame = 0;
-            }
-            enemies[i].frameTimer = 0;
-        }
+    int sceneDrawCalls = drawCalls;
+    int count = profileFrameCount < PROFILE_HISTORY ? profileFrameCount : PROFILE_HISTORY;
+    const int graphH = 100;
+    const int graphX = WINDOW_WIDTH - PROFILE_HISTORY - 10;
+    const int graphY = 10;
 
-        
-        if (enemies[i].x <= enemies[i].patrolStart || enemies[i].x >= enemies[i].patrolEnd) {
-            enemies[i].vx *= -1;
-        }
+    SDL_Rect* bars = ARENA_ARRAY(&scratch, SDL_Rect, count);
+    float* sorted = ARENA_ARRAY(&scratch, float, count);
+    if (!bars || !sorted) return;
+
+    for (int i = 0; i < count; i++) {
+        float ms = profileFrameMs[(profileFrameCount - count + i) % PROFILE_HISTORY];
+        int h = (int)(ms * PROFILE_PIXELS_PER_MS);
+        if (h > graphH) h = graphH;
+
+        bars[i] = (SDL_Rect){ graphX + i, graphY + graphH - h, 1, h };
+        sorted[i] = ms;
     }
+    qsort(sorted, count, sizeof(float), compareFloats);
+
+    SDL_Rect panel = { graphX, graphY, PROFILE_HISTORY, graphH };
+    int budgetY = graphY + graphH - (int)(TICK_DT * 1000.0 * PROFILE_PIXELS_PER_MS);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(renderer, &panel);
+    SDL_SetRenderDrawColor(renderer, 0, 255, 0, 255);
+    SDL_RenderFillRects(renderer, bars, count);
+    SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
+    SDL_RenderDrawLine(renderer, graphX, budgetY, graphX + PROFILE_HISTORY - 1, budgetY);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 
+    static TextLabel labels[1 + PROFILE_MAX_STAGES];
+    SDL_Color color = { 255, 255, 255, 255 };
+    int y = graphY + graphH + 5;
 
-    if (player->x <= 0) player->x = 0;
-    if (player->x >= LEVEL_WIDTH - player->w) player->x = LEVEL_WIDTH - player->w;
+    const char* text = arenaPrintf(&scratch, "p50 %.2f ms  p99 %.2f ms  %d draws",
+                                   sorted[count / 2], sorted[(count - 1) * 99 / 100], sceneDrawCalls);
+    setLabel(&labels[0], hudFont, text, 10, y, color);
+    drawLabel(&labels[0]);
 
-   
-    for (int i = 0; i < MAX_COINS; i++) {  // Coin Animation
-        if (!coins[i].collected) {
-            coins[i].frameTimer++;
-            if (coins[i].frameTimer >= coins[i].frameDelay) {
-                coins[i].frame++;
-                if (coins[i].frame >= coins[i].totalFrames) {
-                    coins[i].frame = 0;
-                }
-                coins[i].frameTimer = 0;
-            }
-        }
+    for (int s = 0; s < profileStageCount; s++) {
+        y += hudFont->height;
+        text = arenaPrintf(&scratch, "%s %.3f ms", profileStageNames[s], profileStageMs[s]);
+        setLabel(&labels[1 + s], hudFont, text, 10, y, color);
+        drawLabel(&labels[1 + s]);
     }
+    flushBatch();
 }
 
-// Check collisions 
-void checkCollisions(Player* player) {
-    
-    float groundY = WINDOW_HEIGHT - GROUND_HEIGHT - player->h;
-   
-    if (player->y >= groundY && player->x < 800 ) {
-        player->y = groundY;
-        player->vy = 0;
-        player->onGround = true;
-    }
+void stopProfiler() {
+    if (profileCaptureFramesLeft > 0) writeProfileTrace(PROFILE_TRACE_PATH);
+    free(profileCapture);
+    profileCapture = NULL;
+}
+#endif
 
-    for (int i = 0; i < MAX_PLATFORMS; i++) {
-        if (!platforms[i].isActive) continue;
-        
-        SDL_Rect *plat = &platforms[i].rect;
+#ifdef PLATFORMER_LIB
+// Batch simulation API, see platformer_env.h. The pool takes worlds in batches of
+// ENV_BATCH_SIZE neighbours, so each thread walks its own stretch of the world array
+#define ENV_BATCH_SIZE 32
+#define MAX_ENV_WORKERS 64
+#define ENV_GOAL_REWARD 10.0f
+#define ENV_DEATH_REWARD -1.0f
 
-        if (player->x + player->w > plat->x &&
-            player->x < plat->x + plat->w &&
-            player->y + player->h >= plat->y &&
-            player->y + player->h <= plat->y + plat->h &&
-            player->vy >= 0) {
-            player->y = plat->y - player->h;
-            player->vy = 0;
-            player->onGround = true;
-        }
-    }
+struct Env {
+    Uint8 *worlds;             // count of them in one allocation, worldSize() apart
+    int count;
+    Uint32 *episodeTicks;
+    SDL_Thread *workers[MAX_ENV_WORKERS];
+    int workerCount;
+    SDL_sem *start;            // posted once per worker for every step
+    SDL_sem *finished;         // and posted back by each worker when it runs out of batches
+    bool stopping;
 
-   
-    for (int i = 0; i < MAX_COINS; i++) {
-        if (coins[i].collected) continue;
+    // The step being run, set before the workers are started
+    const Uint8 *actions;
+    float *observations;
+    float *rewards;
+    Uint8 *dones;
+    SDL_atomic_t nextBatch;
+};
 
-        if (player->x + player->w > coins[i].x &&
-            player->x < coins[i].x + coins[i].w &&
-            player->y + player->h > coins[i].y &&
-            player->y < coins[i].y + coins[i].h) {
-            coins[i].collected = true;
-            score++;
-            SDL_Log("Coin collected! Score: %d", score);
-        }
+// Insert a point into a list of the nearest ones so far, nearest first
+static void keepNearest(float* out, float* distance, int* found, float dx, float dy) {
+    float d = dx * dx + dy * dy;
+    int k;
+
+    if (*found < ENV_NEAREST) {
+        k = (*found)++;
+    } else if (d < distance[ENV_NEAREST - 1]) {
+        k = ENV_NEAREST - 1;
+    } else {
+        return;
+    }
+
+    while (k > 0 && distance[k - 1] > d) {
+        distance[k] = distance[k - 1];
+        out[k * 2] = out[k * 2 - 2];
+        out[k * 2 + 1] = out[k * 2 - 1];
+        k--;
     }
+    distance[k] = d;
+    out[k * 2] = dx;
+    out[k * 2 + 1] = dy;
 }
 
+static void observeWorld(const World* w, float* obs) {
+    const Player* player = &w->player;
+    float cx = player->x + player->w / 2;
+    float cy = player->y + player->h / 2;
 
-void checkEnemyCollisions(Player* player) {
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        if (player->x + player->w > enemies[i].x &&
-            player->x < enemies[i].x + enemies[i].w &&
-            player->y + player->h > enemies[i].y &&
-            player->y < enemies[i].y + enemies[i].h) {
-            
-            displayMessage("Game Over! Hit by enemy!", (SDL_Color){255, 0, 0});
-            resetGame(player);
-            break;
+    obs[0] = player->x;
+    obs[1] = player->y;
+    obs[2] = player->vx;
+    obs[3] = player->vy;
+    obs[4] = player->onGround;
+
+    float* nearestEnemies = obs + 5;
+    float* nearestCoins = nearestEnemies + ENV_NEAREST * 2;
+    float distance[ENV_NEAREST];
+    int found = 0;
+    memset(nearestEnemies, 0, ENV_NEAREST * 4 * sizeof(float));
+
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_ENEMIES;
+        for (int i = first; i < first + w->slots[w->activeSlots[a]].enemyCount; i++) {
+            keepNearest(nearestEnemies, distance, &found,
+                        w->enemies.x[i] + w->enemies.w[i] / 2 - cx, w->enemies.y[i] + w->enemies.h[i] / 2 - cy);
         }
     }
-}
 
+    found = 0;
+    for (int a = 0; a < w->activeSlotCount; a++) {
+        int first = w->activeSlots[a] * CHUNK_MAX_COINS;
+        for (int i = first; i < first + w->slots[w->activeSlots[a]].coinCount; i++) {
+            if (w->coins.collected[i]) continue;
+            keepNearest(nearestCoins, distance, &found,
+                        w->coins.x[i] + w->coins.w[i] / 2 - cx, w->coins.y[i] + w->coins.h[i] / 2 - cy);
+        }
+    }
 
-void displayMessage(const char* message, SDL_Color color) {
-    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    SDL_RenderClear(renderer);
-
-    SDL_Surface* messageSurface = TTF_RenderText_Solid(font, message, color);
-    SDL_Texture* messageTexture = SDL_CreateTextureFromSurface(renderer, messageSurface);
-    SDL_Rect messageRect = {
-        WINDOW_WIDTH / 2 - messageSurface->w / 2,
-        WINDOW_HEIGHT / 2 - messageSurface->h / 2,
-        messageSurface->w,
-        messageSurface->h
-    };
-    
-    SDL_RenderCopy(renderer, messageTexture, NULL, &messageRect);
-    SDL_RenderPresent(renderer);
-    SDL_Delay(1000);  
+    const LevelRect* goal = level.goal;
+    obs[ENV_OBS_SIZE - 2] = goal->x + goal->w / 2.0f - cx;
+    obs[ENV_OBS_SIZE - 1] = goal->y + goal->h / 2.0f - cy;
+}
 
-    SDL_FreeSurface(messageSurface);
-    SDL_DestroyTexture(messageTexture);
+static World* envWorld(Env* env, int i) {
+    return (World*)(env->worlds + (size_t)i * worldSize());
 }
 
+static void stepWorld(Env* env, int i) {
+    World* w = envWorld(env, i);
+    int coinsTaken = w->coinsTaken, wins = w->wins, deaths = w->deaths;
 
-void checkGoalCollision(Player* player) {
-    if (player->x + player->w > goal.x &&
-        player->x < goal.x + goal.w &&
-        player->y + player->h > goal.y &&
-        player->y < goal.y + goal.h) {
-        
-        displayMessage("You win!", (SDL_Color){255, 255, 0});
-        resetGame(player);
+    simulateTick(w, env->actions ? env->actions[i] : 0);
+
+    // A win or a death ends the episode at once, the env doesn't wait out the message
+    bool done = w->wins != wins || w->deaths != deaths;
+    if (done) {
+        resetGame(w);
+    } else if (++env->episodeTicks[i] >= ENV_MAX_EPISODE_TICKS) {
+        resetGame(w);
+        done = true;
     }
+    if (done) env->episodeTicks[i] = 0;
+
+    if (env->rewards) {
+        env->rewards[i] = (w->coinsTaken - coinsTaken) + ENV_GOAL_REWARD * (w->wins - wins) +
+                          ENV_DEATH_REWARD * (w->deaths - deaths);
+    }
+    if (env->dones) env->dones[i] = done;
+    if (env->observations) observeWorld(w, env->observations + (size_t)i * ENV_OBS_SIZE);
 }
 
+static void runEnvBatches(Env* env) {
+    int batches = (env->count + ENV_BATCH_SIZE - 1) / ENV_BATCH_SIZE;
 
-void checkFallDetection(Player* player) {
-    if (player->y > WINDOW_HEIGHT + 100) {
-        displayMessage("Game Over! You fell!", (SDL_Color){255, 0, 0});
-        resetGame(player);
+    for (;;) {
+        int b = SDL_AtomicAdd(&env->nextBatch, 1);
+        if (b >= batches) break;
+
+        int end = (b + 1) * ENV_BATCH_SIZE;
+        if (end > env->count) end = env->count;
+        for (int i = b * ENV_BATCH_SIZE; i < end; i++) stepWorld(env, i);
     }
 }
 
+static int envWorker(void* data) {
+    Env* env = data;
+    PROFILE_THREAD("env");
 
-void updateCamera(Player player) {
-    camera.x = (int)(player.x + player.w / 2) - WINDOW_WIDTH / 2;
-    camera.y = (int)(player.y + player.h / 2) - WINDOW_HEIGHT / 2;
-    
-    
-    if (camera.x < 0) camera.x = 0;
-    if (camera.y < 0) camera.y = 0;
-    if (camera.x > LEVEL_WIDTH - WINDOW_WIDTH) camera.x = LEVEL_WIDTH - WINDOW_WIDTH;
+    for (;;) {
+        SDL_SemWait(env->start);
+        if (env->stopping) break;
+
+        PROFILE_BEGIN(envBatches);
+        runEnvBatches(env);
+        PROFILE_END(envBatches);
+        SDL_SemPost(env->finished);
+    }
+    freeArena(&scratch);
+    return 0;
 }
 
+Env* env_create(int n) {
+    if (n <= 0 || level.data) return NULL;     // one Env at a time, they share the level
 
-void renderScene(Player player) {
-    
-    SDL_RenderClear(renderer);
-    SDL_RenderCopy(renderer, bgTexture, NULL, NULL);
+    // Nothing is drawn, the sprites are only needed for their sizes
+    headless = true;
 
-   
-    SDL_Rect groundSrcRect = { 0, 0, 32, 32 }; // The grass+dirt tile
-    SDL_Rect dirtSrcRect = { 0, 16, 32, 16 };  // Just the dirt part
+    Env* env = calloc(1, sizeof(Env));
+    if (!env) {
+        printf("Out of memory for %d worlds!\n", n);
+        return NULL;
+    }
 
-    
-    int startX = camera.x / 32;                       
-    int endX = (camera.x + WINDOW_WIDTH) / 32 + 1;    
-    int groundX = 0;                                  
-    int groundEndX = 800 / 32;;              
+    if (!loadSpriteSizes(spriteSheets, SPRITE_SHEET_COUNT) || !loadLevel(LEVEL_PATH)) {
+        env_destroy(env);
+        return NULL;
+    }
 
-    //ground
-    for (int i = startX; i <= endX; i++) {
-        
-        if (i >= groundX && i < groundEndX) {
-            
-            SDL_Rect groundDestRect = {
-                (i * 32) - camera.x,
-                WINDOW_HEIGHT - GROUND_HEIGHT - camera.y,
-                32,
-                32
-            };
-            SDL_RenderCopy(renderer, terrainTexture, &groundSrcRect, &groundDestRect);
-            
-            // dirt tiles
-            for (int j = 1; j < (GROUND_HEIGHT / 16); j++) {
-                SDL_Rect dirtDestRect = {
-                    (i * 32) - camera.x,
-                    WINDOW_HEIGHT - GROUND_HEIGHT + (j * 16) - camera.y,
-                    32,
-                    16
-                };
-                SDL_RenderCopy(renderer, terrainTexture, &dirtSrcRect, &dirtDestRect);
-            }
+    env->worlds = malloc((size_t)n * worldSize());
+    env->episodeTicks = calloc(n, sizeof(Uint32));
+    env->start = SDL_CreateSemaphore(0);
+    env->finished = SDL_CreateSemaphore(0);
+    if (!env->worlds || !env->episodeTicks || !env->start || !env->finished) {
+        printf("Out of memory for %d worlds!\n", n);
+        env_destroy(env);
+        return NULL;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!initWorld(envWorld(env, i))) {
+            env_destroy(env);
+            return NULL;
         }
+        env->count = i + 1;
+        resetGame(envWorld(env, i));
     }
 
-    
-    SDL_Rect platformSrcRect = { 96, 0, 16, 16 }; 
+    // The calling thread steps batches too, so one fewer worker than cores
+    int batches = (n + ENV_BATCH_SIZE - 1) / ENV_BATCH_SIZE;
+    int workers = SDL_GetCPUCount() - 1;
+    if (workers > MAX_ENV_WORKERS) workers = MAX_ENV_WORKERS;
+    if (workers > batches - 1) workers = batches - 1;
 
-    
-    for (int i = 0; i < MAX_PLATFORMS; i++) {
-        if (!platforms[i].isActive) continue;
-        
-        SDL_Rect platRect = {
-            platforms[i].rect.x - camera.x,
-            platforms[i].rect.y - camera.y,
-            platforms[i].rect.w,
-            platforms[i].rect.h
-        };
-        
-        
-        int tilesNeeded = platforms[i].rect.w / 16;
-        for (int j = 0; j < tilesNeeded; j++) {
-            SDL_Rect tileDestRect = {
-                platforms[i].rect.x - camera.x + (j * 16),
-                platforms[i].rect.y - camera.y,
-                16,
-                platforms[i].rect.h
-            };
-            SDL_RenderCopy(renderer, platformTexture, &platformSrcRect, &tileDestRect);
+    for (int i = 0; i < workers; i++) {
+        env->workers[i] = SDL_CreateThread(envWorker, "env worker", env);
+        if (!env->workers[i]) {
+            printf("Unable to start an env worker! SDL Error: %s\n", SDL_GetError());
+            break;
         }
+        env->workerCount++;
     }
 
-    //player
-    SDL_Rect playerDestRect = {
-        (int)(player.x - camera.x),
-        (int)(player.y - camera.y),
-        (int)player.w, (int)player.h
-    };
-    
+    return env;
+}
 
-    SDL_Rect playerSrcRect = {
-        player.frame * player.frameWidth,
-        0,
-        player.frameWidth,
-        player.frameHeight
-    };
-    
-    
-    SDL_RendererFlip flip = player.facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
-    
-    
-    SDL_RenderCopyEx(renderer, playerTexture, &playerSrcRect, &playerDestRect, 0.0, NULL, flip);
+void env_destroy(Env* env) {
+    if (!env) return;
 
-    
-    for (int i = 0; i < MAX_COINS; i++) {
-        if (coins[i].collected) continue;
-
-        SDL_Rect coinDestRect = {
-            coins[i].x - camera.x,
-            coins[i].y - camera.y,
-            coins[i].w,
-            coins[i].h
-        };
-        
-        SDL_Rect coinSrcRect = {
-            coins[i].frame * coins[i].frameWidth,
-            0,
-            coins[i].frameWidth,
-            coins[i].frameHeight
-        };
-        
-        SDL_RenderCopy(renderer, coinTexture, &coinSrcRect, &coinDestRect);
-    }
+    env->stopping = true;
+    for (int i = 0; i < env->workerCount; i++) SDL_SemPost(env->start);
+    for (int i = 0; i < env->workerCount; i++) SDL_WaitThread(env->workers[i], NULL);
 
-    // enemy animation
-    for (int i = 0; i < MAX_ENEMIES; i++) {
-        SDL_Rect enemyDestRect = {
-            enemies[i].x - camera.x,
-            enemies[i].y - camera.y,
-            enemies[i].w,
-            enemies[i].h
-        };
-        
-        
-        SDL_Rect enemySrcRect = {
-            enemies[i].frame * 32,  
-            0,
-            32,                      
-            32
-        };
-        
-        
-        SDL_RendererFlip enemyFlip = enemies[i].facingLeft ? SDL_FLIP_HORIZONTAL : SDL_FLIP_NONE;
-        SDL_RenderCopyEx(renderer, enemyTexture, &enemySrcRect, &enemyDestRect, 0.0, NULL, enemyFlip);
+    if (env->start) SDL_DestroySemaphore(env->start);
+    if (env->finished) SDL_DestroySemaphore(env->finished);
+
+    for (int i = 0; i < env->count; i++) freeWorld(envWorld(env, i));
+    free(env->worlds);
+    free(env->episodeTicks);
+    free(env);
+    unloadLevel();
+    freeArena(&scratch);
+}
+
+void env_reset(Env* env, float* observations) {
+    for (int i = 0; i < env->count; i++) {
+        resetGame(envWorld(env, i));
+        env->episodeTicks[i] = 0;
+        if (observations) observeWorld(envWorld(env, i), observations + (size_t)i * ENV_OBS_SIZE);
     }
+}
 
-   
-    SDL_Rect goalDraw = {
-        goal.x - camera.x,
-        goal.y - camera.y,
-        goal.w,
-        goal.h
-    };
-    SDL_RenderCopy(renderer, goalTexture, NULL, &goalDraw);
-    
+void env_step(Env* env, const unsigned char* actions, float* observations, float* rewards, unsigned char* dones) {
+    env->actions = actions;
+    env->observations = observations;
+    env->rewards = rewards;
+    env->dones = dones;
+    SDL_AtomicSet(&env->nextBatch, 0);
 
-    
-    char scoreText[32];
-    sprintf(scoreText, "Score: %d", score);
+    for (int i = 0; i < env->workerCount; i++) SDL_SemPost(env->start);
+    runEnvBatches(env);
+    for (int i = 0; i < env->workerCount; i++) SDL_SemWait(env->finished);
+}
+#else
+#ifdef COUNT_ALLOCS
+static SDL_malloc_func sdlMalloc;
+static SDL_calloc_func sdlCalloc;
+static SDL_realloc_func sdlRealloc;
+static SDL_free_func sdlFree;
 
-    SDL_Color textColor = { 255, 255, 255 }; 
-    SDL_Surface* textSurface = TTF_RenderText_Solid(font, scoreText, textColor);
-    SDL_Texture* textTexture = SDL_CreateTextureFromSurface(renderer, textSurface);
+static void* countedMalloc(size_t size) {
+    COUNT_ALLOCATION();
+    return sdlMalloc(size);
+}
 
-    SDL_Rect textRect = { 10, 10, textSurface->w, textSurface->h };
-    SDL_RenderCopy(renderer, textTexture, NULL, &textRect);
+static void* countedCalloc(size_t count, size_t size) {
+    COUNT_ALLOCATION();
+    return sdlCalloc(count, size);
+}
 
-    SDL_FreeSurface(textSurface);
-    SDL_DestroyTexture(textTexture);
+static void* countedRealloc(void* block, size_t size) {
+    COUNT_ALLOCATION();
+    return sdlRealloc(block, size);
+}
 
-    
-    SDL_RenderPresent(renderer);
+// Must run before SDL allocates anything, memory has to be freed by the functions that made it
+static void countSDLAllocations(void) {
+    SDL_GetMemoryFunctions(&sdlMalloc, &sdlCalloc, &sdlRealloc, &sdlFree);
+    SDL_SetMemoryFunctions(countedMalloc, countedCalloc, countedRealloc, sdlFree);
 }
+#endif
 
 int main(int argc, char *argv[]) {
+#ifdef COUNT_ALLOCS
+    countSDLAllocations();
+#endif
+    startupCounter = SDL_GetPerformanceCounter();
+    PROFILE_THREAD("main");
+
+#ifdef PROFILE
+    // --trace captures from startup, so the decode and stream threads show up too
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0) startProfileCapture();
+    }
+#endif
+
+    // --headless simulates without a window, for --ticks <n> ticks of random input
+    // from --seed <n>, or a whole --replay
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) headless = true;
+        if (strcmp(argv[i], "--ticks") == 0 && i + 1 < argc) headlessTicks = strtoull(argv[i + 1], NULL, 10);
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) inputRandom = (Uint32)strtoul(argv[i + 1], NULL, 10);
+    }
+    if (inputRandom == 0) inputRandom = 1;
 
     if (!initSDL()) {   
         return 1;
     }
     
     
-    if (!loadMedia()) {
+    if (headless ? !loadSpriteSizes(spriteSheets, SPRITE_SHEET_COUNT) : !loadMedia(drawLoadingProgress)) {
+        return 1;
+    }
+
+    if (!loadLevel(LEVEL_PATH)) {
+        return 1;
+    }
+
+    // The game is a single world, filled by the streaming thread
+    World* world = malloc(worldSize());
+    if (!world) {
+        printf("Out of memory for the world!\n");
+        return 1;
+    }
+
+    if (!initWorld(world) || !initRewind(world)) {
+        return 1;
+    }
+
+    if (!initStreaming(world, LEVEL_PATH)) {
         return 1;
     }
     
     
-    Player player = {START_X, START_Y, 50, 50, 0, 0, false, false};
-    
-    
-    resetGame(&player);
-   
+    resetGame(world);
+
+    // --record <file> saves this run's input, --replay <file> plays one back instead of the keyboard
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0) startRecording(argv[i + 1]);
+        if (strcmp(argv[i], "--replay") == 0 && !loadReplay(argv[i + 1])) return 1;
+    }
 
-    bool running = true;
+    if (headless) runHeadless(world);
+
+    // Windowed, the world ticks on the sim thread from here on and this loop only draws
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    bool running = !headless && startSimulation(world);
     while (running) {
-        
-        handleInput(&player, &running);
-        
-       
-        updatePhysics(&player);
-        
-        
-        checkCollisions(&player);
-        checkEnemyCollisions(&player);
-        checkGoalCollision(&player);
-        checkFallDetection(&player);
-        
-        
-        updateCamera(player);
-        
-        
-        renderScene(player);
-        
-        
-        SDL_Delay(16); 
+        Uint64 counter = SDL_GetPerformanceCounter();
+        resetArena(&scratch);
+#ifdef COUNT_ALLOCS
+        int allocationsBefore = SDL_AtomicGet(&allocationCount);
+#endif
+
+        handleEvents(&running);
+        SDL_AtomicSet(&liveInput, sampleInput());
+        if (SDL_AtomicGet(&simFinished)) running = false;
+
+        PROFILE_BEGIN(pumpAssets);
+        pumpAssets();
+        PROFILE_END(pumpAssets);
+        // Interpolate by how long ago the newest tick was due, holding it if the sim falls behind
+        const RenderSnapshot* snapshot = latestSnapshot();
+        double alpha = (double)(Sint64)(counter - snapshot->tickCounter) / frequency / TICK_DT;
+        if (alpha < 0.0) alpha = 0.0;
+        if (alpha > 1.0) alpha = 1.0;
+
+        PROFILE_BEGIN(renderScene);
+        renderScene(snapshot, (float)alpha);
+        PROFILE_END(renderScene);
+
+#ifdef PROFILE
+        profileEndFrame(counter);
+#endif
+
+        static bool firstFrame = true;
+        if (firstFrame) {
+            SDL_Log("Startup: first frame at %.1f ms", millisecondsSinceStartup());
+            firstFrame = false;
+        }
+
+#ifdef COUNT_ALLOCS
+        // Once loading is done a frame, and the ticks it overlapped, should allocate nothing
+        static int frame = 0;
+        int allocations = SDL_AtomicGet(&allocationCount) - allocationsBefore;
+        if (++frame > ALLOCATION_WARMUP_FRAMES && allocations > 0) {
+            SDL_Log("Frame %d made %d heap allocations", frame, allocations);
+        }
+#endif
     }
     
     
+    stopSimulation();
+#ifdef PROFILE
+    stopProfiler();
+#endif
+    stopReplay();
+    stopStreaming();
+    freeWorld(world);
+    free(world);
+    unloadLevel();
+    freeArena(&scratch);
     cleanupSDL();
     
     return 0;
-}
\ No newline at end of file
+}
+#endif
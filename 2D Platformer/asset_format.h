@@ -0,0 +1,55 @@
+// Packed asset archive shared by the game and the assetpack tool.
+//
+// An archive is a header, a table of entries sorted by name, then one pixel
+// blob per entry starting on an ASSET_ALIGN boundary. Blobs are already
+// decoded to RGBA32, so the game can map the file and wrap surfaces around
+// the pixels without decoding or copying. All values are little-endian.
+#ifndef ASSET_FORMAT_H
+#define ASSET_FORMAT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ASSET_MAGIC 0x54534150u        // "PAST"
+#define ASSET_VERSION 1
+#define ASSET_ALIGN 64
+#define ASSET_NAME_MAX 128
+
+// How a blob is stored
+enum {
+    ASSET_RAW = 0,                     // pitch * h bytes of RGBA32
+    ASSET_LZ4 = 1,                     // LZ4 block that inflates to the raw pixels
+};
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+} AssetHeader;
+
+typedef struct {
+    char name[ASSET_NAME_MAX];         // path the game asks for, e.g. "assets/Terrain (16x16).png"
+    uint64_t offset;                   // from the start of the file
+    uint32_t size;                     // stored bytes
+    uint32_t compression;              // ASSET_RAW or ASSET_LZ4
+    int32_t w, h, pitch;
+    int32_t frameW, frameH;            // animation frame size, the whole image if the name has none
+    uint32_t reserved;
+} AssetEntry;
+
+// Frame size from a "(32x32)" tag in a file name, falling back to the whole image
+static inline void assetFrameSize(const char* name, int w, int h, int* frameW, int* frameH) {
+    *frameW = w;
+    *frameH = h;
+
+    for (const char* p = name; *p; p++) {
+        int fw, fh, used = 0;
+        if (*p == '(' && sscanf(p, "(%dx%d)%n", &fw, &fh, &used) == 2 && used > 0 && fw > 0 && fh > 0) {
+            *frameW = fw;
+            *frameH = fh;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+// assetpack: decodes every PNG under a directory once, offline, into a packed
+// archive of RGBA32 blobs the game maps at startup (see asset_format.h).
+//
+//   gcc assetpack.c -o assetpack -lSDL2 -lSDL2_image
+//   ./assetpack assets assets.pak
+//
+// Built with -DUSE_LZ4 and -llz4, --lz4 stores the blobs LZ4-compressed. That
+// makes the archive smaller, but the game then has to inflate them.
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_image.h>
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#ifdef USE_LZ4
+#include <lz4.h>
+#endif
+#include "asset_format.h"
+
+typedef struct {
+    AssetEntry *entries;
+    int count;
+    int capacity;
+} EntryList;
+
+static bool endsWith(const char* s, const char* suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && SDL_strcasecmp(s + n - m, suffix) == 0;
+}
+
+// Collect every .png below dir, names are the paths as the game opens them
+static bool collect(const char* dir, EntryList* list) {
+    DIR* d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "Unable to open %s!\n", dir);
+        return false;
+    }
+
+    struct dirent* item;
+    bool ok = true;
+    while (ok && (item = readdir(d))) {
+        if (item->d_name[0] == '.') continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, item->d_name);
+
+        struct stat info;
+        if (stat(path, &info) < 0) continue;
+
+        if (S_ISDIR(info.st_mode)) {
+            ok = collect(path, list);
+        } else if (endsWith(path, ".png")) {
+            if (strlen(path) >= ASSET_NAME_MAX) {
+                fprintf(stderr, "%s: name longer than %d characters\n", path, ASSET_NAME_MAX - 1);
+                ok = false;
+                break;
+            }
+            if (list->count == list->capacity) {
+                list->capacity = list->capacity ? list->capacity * 2 : 256;
+                list->entries = realloc(list->entries, list->capacity * sizeof(AssetEntry));
+                if (!list->entries) {
+                    fprintf(stderr, "Out of memory!\n");
+                    exit(1);
+                }
+            }
+            AssetEntry* e = &list->entries[list->count++];
+            memset(e, 0, sizeof(*e));
+            strcpy(e->name, path);
+        }
+    }
+
+    closedir(d);
+    return ok;
+}
+
+static int compareEntries(const void* a, const void* b) {
+    return strcmp(((const AssetEntry*)a)->name, ((const AssetEntry*)b)->name);
+}
+
+int main(int argc, char* argv[]) {
+    bool lz4 = argc == 4 && strcmp(argv[3], "--lz4") == 0;
+    if (argc != 3 && !lz4) {
+        fprintf(stderr, "usage: %s <asset dir> <archive> [--lz4]\n", argv[0]);
+        return 1;
+    }
+#ifndef USE_LZ4
+    if (lz4) {
+        fprintf(stderr, "%s was built without LZ4 support\n", argv[0]);
+        return 1;
+    }
+#endif
+
+    if (!(IMG_Init(IMG_INIT_PNG) & IMG_INIT_PNG)) {
+        fprintf(stderr, "SDL_image could not initialize! SDL_image Error: %s\n", IMG_GetError());
+        return 1;
+    }
+
+    EntryList list = { NULL, 0, 0 };
+    if (!collect(argv[1], &list)) return 1;
+
+    // Sorted so the game can binary search by name
+    qsort(list.entries, list.count, sizeof(AssetEntry), compareEntries);
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "Unable to create %s!\n", argv[2]);
+        return 1;
+    }
+
+    AssetHeader header = { ASSET_MAGIC, ASSET_VERSION, list.count, 0 };
+    uint64_t offset = sizeof(header) + (uint64_t)list.count * sizeof(AssetEntry);
+    uint64_t rawBytes = 0;
+    bool ok = true;
+
+    for (int i = 0; i < list.count && ok; i++) {
+        AssetEntry* e = &list.entries[i];
+
+        SDL_Surface* loaded = IMG_Load(e->name);
+        SDL_Surface* rgba = loaded ? SDL_ConvertSurfaceFormat(loaded, SDL_PIXELFORMAT_RGBA32, 0) : NULL;
+        SDL_FreeSurface(loaded);
+        if (!rgba) {
+            fprintf(stderr, "Unable to decode %s! SDL Error: %s\n", e->name, SDL_GetError());
+            ok = false;
+            break;
+        }
+
+        e->w = rgba->w;
+        e->h = rgba->h;
+        e->pitch = rgba->w * 4;
+        assetFrameSize(e->name, e->w, e->h, &e->frameW, &e->frameH);
+
+        // Tightly packed rows, whatever pitch SDL gave the surface
+        uint32_t rawSize = (uint32_t)e->pitch * e->h;
+        unsigned char* pixels = malloc(rawSize);
+        for (int y = 0; y < e->h; y++) {
+            memcpy(pixels + y * e->pitch, (unsigned char*)rgba->pixels + y * rgba->pitch, e->pitch);
+        }
+        SDL_FreeSurface(rgba);
+        rawBytes += rawSize;
+
+        unsigned char* blob = pixels;
+        e->size = rawSize;
+        e->compression = ASSET_RAW;
+#ifdef USE_LZ4
+        if (lz4) {
+            blob = malloc(LZ4_compressBound(rawSize));
+            e->size = LZ4_compress_default((const char*)pixels, (char*)blob, rawSize, LZ4_compressBound(rawSize));
+            e->compression = ASSET_LZ4;
+        }
+#endif
+
+        offset = (offset + ASSET_ALIGN - 1) / ASSET_ALIGN * ASSET_ALIGN;
+        e->offset = offset;
+        fseek(out, (long)offset, SEEK_SET);
+        fwrite(blob, 1, e->size, out);
+        offset += e->size;
+
+        if (blob != pixels) free(blob);
+        free(pixels);
+    }
+
+    fseek(out, 0, SEEK_SET);
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(list.entries, sizeof(AssetEntry), list.count, out);
+
+    if (ferror(out)) ok = false;
+    if (fclose(out) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "Failed writing %s!\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %d images, %llu bytes of pixels, %llu bytes%s\n", argv[2], list.count,
+           (unsigned long long)rawBytes, (unsigned long long)offset, lz4 ? " (LZ4)" : "");
+
+    free(list.entries);
+    IMG_Quit();
+    return 0;
+}
@@ -0,0 +1,40 @@
+// Baked bitmap font shared by the game and the fontbake tool.
+//
+// A .font file holds one or more pixel sizes of a font, each already
+// rasterized and packed onto its own page: a header, a FontSize table, then
+// one 8-bit coverage page per size. The game draws text from it without
+// SDL_ttf or FreeType. All values are little-endian.
+#ifndef FONT_FORMAT_H
+#define FONT_FORMAT_H
+
+#include <stdint.h>
+
+#define FONT_MAGIC 0x544E4650u         // "PFNT"
+#define FONT_VERSION 1
+#define FONT_FIRST_GLYPH 32
+#define FONT_LAST_GLYPH 126
+#define FONT_GLYPH_COUNT (FONT_LAST_GLYPH - FONT_FIRST_GLYPH + 1)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sizeCount;
+    uint32_t reserved;
+} FontFileHeader;
+
+typedef struct {
+    int16_t x, y, w, h;                // cell on the page, w == 0 if there is nothing to draw
+    int16_t advance;                   // 0 for glyphs that weren't baked
+    int16_t reserved;
+} FontGlyph;
+
+typedef struct {
+    int32_t size;                      // point size it was rasterized at
+    int32_t height;                    // line height
+    int32_t pageW, pageH;
+    uint32_t pixelOffset;              // pageW * pageH coverage bytes, from the start of the file
+    uint32_t reserved;
+    FontGlyph glyphs[FONT_GLYPH_COUNT];
+} FontSize;
+
+#endif
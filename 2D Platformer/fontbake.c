@@ -0,0 +1,190 @@
+// fontbake: rasterizes the glyphs the game draws, at the sizes it draws them,
+// into a small .font file (see font_format.h) so the game doesn't need SDL_ttf
+// or a font tree at runtime.
+//
+//   gcc fontbake.c -o fontbake -lSDL2 -lSDL2_ttf
+//   ./fontbake fonts/TTF/ARIAL.TTF fonts/arial.font 24 48
+//
+// --chars "<text>" bakes only those characters instead of all printable ASCII.
+#include <SDL2/SDL.h>
+#include <SDL2/SDL_ttf.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "font_format.h"
+
+#define MAX_SIZES 8
+#define MAX_PAGE_SIZE 2048
+#define GLYPH_PADDING 1        // empty pixels between glyphs so sampling never bleeds
+
+// Rasterize one size and pack it, returns the coverage page
+static unsigned char* bakeSize(TTF_Font* ttf, FontSize* out, const bool* wanted) {
+    SDL_Surface* glyphs[FONT_GLYPH_COUNT] = { NULL };
+    SDL_Color white = { 255, 255, 255, 255 };
+
+    out->height = TTF_FontHeight(ttf);
+
+    for (int c = FONT_FIRST_GLYPH; c <= FONT_LAST_GLYPH; c++) {
+        FontGlyph* glyph = &out->glyphs[c - FONT_FIRST_GLYPH];
+        int minx, maxx, miny, maxy, advance;
+
+        memset(glyph, 0, sizeof(*glyph));
+        if (!wanted[c - FONT_FIRST_GLYPH]) continue;
+        if (TTF_GlyphMetrics(ttf, c, &minx, &maxx, &miny, &maxy, &advance) < 0) continue;
+        glyph->advance = advance;
+
+        // Spaces have nothing to draw, only an advance
+        if (c == ' ') continue;
+
+        SDL_Surface* rendered = TTF_RenderGlyph_Blended(ttf, c, white);
+        if (rendered) {
+            glyphs[c - FONT_FIRST_GLYPH] = SDL_ConvertSurfaceFormat(rendered, SDL_PIXELFORMAT_RGBA32, 0);
+            SDL_FreeSurface(rendered);
+        }
+    }
+
+    // Row-pack the glyphs, growing the page until they all fit
+    int pageSize = 64;
+    bool fits = false;
+    while (!fits && pageSize <= MAX_PAGE_SIZE) {
+        int penX = 0, penY = 0, rowHeight = 0;
+        fits = true;
+        for (int c = 0; c < FONT_GLYPH_COUNT; c++) {
+            SDL_Surface* g = glyphs[c];
+            if (!g) continue;
+            if (penX + g->w + GLYPH_PADDING > pageSize) {
+                penX = 0;
+                penY += rowHeight;
+                rowHeight = 0;
+            }
+            if (penY + g->h + GLYPH_PADDING > pageSize) {
+                fits = false;
+                pageSize *= 2;
+                break;
+            }
+            FontGlyph* glyph = &out->glyphs[c];
+            glyph->x = penX;
+            glyph->y = penY;
+            glyph->w = g->w;
+            glyph->h = g->h;
+            penX += g->w + GLYPH_PADDING;
+            if (g->h + GLYPH_PADDING > rowHeight) rowHeight = g->h + GLYPH_PADDING;
+        }
+    }
+
+    unsigned char* page = fits ? calloc(pageSize * pageSize, 1) : NULL;
+    out->pageW = pageSize;
+    out->pageH = pageSize;
+
+    // Keep only the alpha, the game tints glyphs with the vertex colour anyway
+    for (int c = 0; c < FONT_GLYPH_COUNT; c++) {
+        SDL_Surface* g = glyphs[c];
+        if (!g) continue;
+        if (page) {
+            FontGlyph* glyph = &out->glyphs[c];
+            for (int y = 0; y < g->h; y++) {
+                const Uint8* row = (const Uint8*)g->pixels + y * g->pitch;
+                for (int x = 0; x < g->w; x++) {
+                    page[(glyph->y + y) * pageSize + glyph->x + x] = row[x * 4 + 3];
+                }
+            }
+        }
+        SDL_FreeSurface(g);
+    }
+
+    return page;
+}
+
+int main(int argc, char* argv[]) {
+    bool wanted[FONT_GLYPH_COUNT];
+    for (int c = 0; c < FONT_GLYPH_COUNT; c++) wanted[c] = true;
+
+    int sizes[MAX_SIZES];
+    int sizeCount = 0;
+    const char* fontPath = NULL;
+    const char* outPath = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--chars") == 0 && i + 1 < argc) {
+            memset(wanted, 0, sizeof(wanted));
+            wanted[' ' - FONT_FIRST_GLYPH] = true;
+            for (const char* c = argv[++i]; *c; c++) {
+                if (*c >= FONT_FIRST_GLYPH && *c <= FONT_LAST_GLYPH) wanted[*c - FONT_FIRST_GLYPH] = true;
+            }
+        } else if (!fontPath) {
+            fontPath = argv[i];
+        } else if (!outPath) {
+            outPath = argv[i];
+        } else if (sizeCount < MAX_SIZES && atoi(argv[i]) > 0) {
+            sizes[sizeCount++] = atoi(argv[i]);
+        } else {
+            fontPath = NULL;
+            break;
+        }
+    }
+
+    if (!fontPath || !outPath || sizeCount == 0) {
+        fprintf(stderr, "usage: %s <font.ttf> <out.font> <size>... [--chars \"<text>\"]\n", argv[0]);
+        return 1;
+    }
+
+    if (TTF_Init() < 0) {
+        fprintf(stderr, "TTF Init failed: %s\n", TTF_GetError());
+        return 1;
+    }
+
+    FontFileHeader header = { FONT_MAGIC, FONT_VERSION, sizeCount, 0 };
+    FontSize table[MAX_SIZES];
+    unsigned char* pages[MAX_SIZES] = { NULL };
+    uint32_t offset = sizeof(header) + sizeCount * sizeof(FontSize);
+    bool ok = true;
+
+    for (int s = 0; s < sizeCount && ok; s++) {
+        TTF_Font* ttf = TTF_OpenFont(fontPath, sizes[s]);
+        if (!ttf) {
+            fprintf(stderr, "Failed to load font %s! SDL_ttf Error: %s\n", fontPath, TTF_GetError());
+            ok = false;
+            break;
+        }
+
+        memset(&table[s], 0, sizeof(table[s]));
+        table[s].size = sizes[s];
+        pages[s] = bakeSize(ttf, &table[s], wanted);
+        TTF_CloseFont(ttf);
+
+        if (!pages[s]) {
+            fprintf(stderr, "Font size %d doesn't fit in a %d px page!\n", sizes[s], MAX_PAGE_SIZE);
+            ok = false;
+            break;
+        }
+
+        table[s].pixelOffset = offset;
+        offset += table[s].pageW * table[s].pageH;
+    }
+
+    FILE* out = ok ? fopen(outPath, "wb") : NULL;
+    if (ok && !out) {
+        fprintf(stderr, "Unable to create %s!\n", outPath);
+        ok = false;
+    }
+
+    if (ok) {
+        fwrite(&header, sizeof(header), 1, out);
+        fwrite(table, sizeof(FontSize), sizeCount, out);
+        for (int s = 0; s < sizeCount; s++) {
+            fwrite(pages[s], 1, table[s].pageW * table[s].pageH, out);
+        }
+        if (ferror(out)) ok = false;
+        if (fclose(out) != 0) ok = false;
+        if (!ok) fprintf(stderr, "Failed writing %s!\n", outPath);
+    }
+
+    if (ok) {
+        printf("%s: %d size(s), %u bytes\n", outPath, sizeCount, offset);
+    }
+
+    for (int s = 0; s < sizeCount; s++) free(pages[s]);
+    TTF_Quit();
+    return ok ? 0 : 1;
+}
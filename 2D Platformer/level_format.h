@@ -0,0 +1,163 @@
+// Binary level format shared by the game and the levelc converter.
+//
+// A .lvl file is a header, a section table, then the section payloads. Every
+// payload starts on a LEVEL_ALIGN boundary so the game can mmap the file and
+// point straight at the data. All values are little-endian.
+//
+// The world is cut into CHUNK_WIDTH pixel wide chunks. Platforms, coins, enemies
+// and ground belong to the chunk their left edge falls in and are stored per
+// chunk, so the game can stream a level of any width through a few slots.
+#ifndef LEVEL_FORMAT_H
+#define LEVEL_FORMAT_H
+
+#include <stdint.h>
+
+#define LEVEL_MAGIC 0x4C564C50u        // "PLVL"
+#define LEVEL_VERSION 3
+#define LEVEL_ALIGN 64
+
+enum {
+    LEVEL_SECTION_GOAL      = 4,       // LevelRect
+    LEVEL_SECTION_CHUNKS    = 6,       // LevelChunkTable followed by LevelChunk[chunkCount]
+};
+
+// Chunking. levelc refuses levels that put more than this in one chunk,
+// which is what bounds the game's resident memory. A platform may reach into
+// the chunk after its own but no further, so a chunk's terrain is its own and
+// the chunk before's
+#define CHUNK_WIDTH 1024
+#define CHUNK_MAX_PLATFORMS 64
+#define CHUNK_MAX_COINS 64
+#define CHUNK_MAX_ENEMIES 32
+#define GROUND_TILE_SIZE 32
+
+enum {
+    COIN_COLUMN_X, COIN_COLUMN_Y, COIN_COLUMN_W, COIN_COLUMN_H,
+    COIN_COLUMN_COUNT
+};
+
+enum {
+    ENEMY_COLUMN_X, ENEMY_COLUMN_Y, ENEMY_COLUMN_W, ENEMY_COLUMN_H,
+    ENEMY_COLUMN_VX, ENEMY_COLUMN_PATROL_START, ENEMY_COLUMN_PATROL_END,
+    ENEMY_COLUMN_TYPE,                 // a LevelEnemyType, stored as a float like the rest
+    ENEMY_COLUMN_COUNT
+};
+
+// Enemy types, one per sprite set under assets/Pixel Adevnture/Enemies. levelc
+// reads them by name, the game gives each its sprite and behaviour
+typedef enum {
+    LEVEL_ENEMY_ANGRYPIG,
+    LEVEL_ENEMY_BAT,
+    LEVEL_ENEMY_BEE,
+    LEVEL_ENEMY_BLUEBIRD,
+    LEVEL_ENEMY_BUNNY,
+    LEVEL_ENEMY_CHAMELEON,
+    LEVEL_ENEMY_CHICKEN,
+    LEVEL_ENEMY_DUCK,
+    LEVEL_ENEMY_FATBIRD,
+    LEVEL_ENEMY_GHOST,
+    LEVEL_ENEMY_MUSHROOM,
+    LEVEL_ENEMY_PLANT,
+    LEVEL_ENEMY_RADISH,
+    LEVEL_ENEMY_RINO,
+    LEVEL_ENEMY_ROCKS,
+    LEVEL_ENEMY_SKULL,
+    LEVEL_ENEMY_SLIME,
+    LEVEL_ENEMY_SNAIL,
+    LEVEL_ENEMY_TRUNK,
+    LEVEL_ENEMY_TURTLE,
+    LEVEL_ENEMY_TYPE_COUNT
+} LevelEnemyType;
+
+static const char* const levelEnemyTypeNames[LEVEL_ENEMY_TYPE_COUNT] = {
+    "angrypig", "bat", "bee", "bluebird", "bunny", "chameleon", "chicken", "duck", "fatbird", "ghost",
+    "mushroom", "plant", "radish", "rino", "rocks", "skull", "slime", "snail", "trunk", "turtle",
+};
+
+#define LEVEL_PLATFORM_ACTIVE 1u
+#define LEVEL_PLATFORM_SOLID 2u        // blocks from every side, not just from above
+#define LEVEL_PLATFORM_HAZARD 4u       // kills on touch
+
+// Terrain collides on a grid of LEVEL_TILE_SIZE cells, so levelc only accepts
+// ground and platforms whose edges fall on it
+#define LEVEL_TILE_SIZE 5
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int32_t width, height;             // level size in pixels
+    float startX, startY;              // player spawn
+    uint32_t sectionCount;
+    uint32_t reserved;
+} LevelHeader;
+
+typedef struct {
+    uint32_t type;
+    uint32_t count;                    // number of objects in the section
+    uint64_t offset;                   // from the start of the file
+    uint64_t size;                     // in bytes
+} LevelSection;
+
+typedef struct {
+    int32_t x, y, w, h;
+    uint32_t flags;
+} LevelPlatform;
+
+typedef struct {
+    int32_t x, y, w, h;
+} LevelRect;
+
+typedef struct {
+    int32_t chunkWidth;
+    uint32_t chunkCount;
+    uint32_t coinCount;                // in the whole level
+    int32_t groundTileSize;
+    float groundY;                     // top of the ground, the same everywhere
+    uint32_t reserved[3];
+} LevelChunkTable;
+
+// A chunk's payload is, each part starting on a LEVEL_ALIGN boundary:
+//   LevelPlatform[platformCount]
+//   coin float columns (COIN_COLUMN_COUNT of them)
+//   enemy float columns (ENEMY_COLUMN_COUNT of them)
+//   uint8_t ground[groundColumns], non-zero where there is ground
+typedef struct {
+    uint64_t offset;                   // from the start of the file
+    uint32_t size;
+    uint32_t firstCoin;                // level-wide index of the chunk's first coin
+    uint16_t platformCount;
+    uint16_t coinCount;
+    uint16_t enemyCount;
+    uint16_t groundColumns;
+} LevelChunk;
+
+// Columns are each padded to LEVEL_ALIGN bytes
+#define LEVEL_COLUMN_STRIDE(count) \
+    ((((uint64_t)(count) * sizeof(float)) + LEVEL_ALIGN - 1) / LEVEL_ALIGN * LEVEL_ALIGN)
+
+#define LEVEL_ALIGN_UP(v) (((uint64_t)(v) + LEVEL_ALIGN - 1) / LEVEL_ALIGN * LEVEL_ALIGN)
+
+// Where each part of a chunk payload starts
+typedef struct {
+    uint64_t platforms, coins, enemies, ground;
+    uint64_t size;
+} LevelChunkLayout;
+
+static inline LevelChunkLayout levelChunkLayout(int platformCount, int coinCount, int enemyCount, int groundColumns) {
+    LevelChunkLayout l;
+    l.platforms = 0;
+    l.coins = LEVEL_ALIGN_UP(platformCount * sizeof(LevelPlatform));
+    l.enemies = l.coins + COIN_COLUMN_COUNT * LEVEL_COLUMN_STRIDE(coinCount);
+    l.ground = l.enemies + ENEMY_COLUMN_COUNT * LEVEL_COLUMN_STRIDE(enemyCount);
+    l.size = LEVEL_ALIGN_UP(l.ground + groundColumns);
+    return l;
+}
+
+// Largest payload a chunk can have, what the game sizes its slots for
+#define CHUNK_MAX_PAYLOAD \
+    (LEVEL_ALIGN_UP(CHUNK_MAX_PLATFORMS * sizeof(LevelPlatform)) + \
+     COIN_COLUMN_COUNT * LEVEL_COLUMN_STRIDE(CHUNK_MAX_COINS) + \
+     ENEMY_COLUMN_COUNT * LEVEL_COLUMN_STRIDE(CHUNK_MAX_ENEMIES) + \
+     LEVEL_ALIGN_UP(CHUNK_WIDTH / GROUND_TILE_SIZE))
+
+#endif
@@ -0,0 +1,320 @@
+// levelc: converts a text level (see levels/level1.txt) into the binary .lvl
+// format the game maps at startup.
+//
+//   gcc levelc.c -o levelc
+//   ./levelc levels/level1.txt levels/level1.lvl
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "level_format.h"
+
+typedef struct {
+    void *data;
+    int count;
+    int capacity;
+    size_t itemSize;
+} List;
+
+// One float per column, in column order
+typedef struct {
+    float v[COIN_COLUMN_COUNT];
+} CoinDef;
+
+typedef struct {
+    float v[ENEMY_COLUMN_COUNT];
+} EnemyDef;
+
+typedef struct {
+    int fromX, toX;
+} GroundDef;
+
+static void* push(List* list) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->data = realloc(list->data, list->capacity * list->itemSize);
+        if (!list->data) {
+            fprintf(stderr, "Out of memory!\n");
+            exit(1);
+        }
+    }
+    return (char*)list->data + list->count++ * list->itemSize;
+}
+
+static uint64_t alignUp(uint64_t v) {
+    return LEVEL_ALIGN_UP(v);
+}
+
+// Chunk an object belongs to, things hanging off either end go in the first or last
+static int chunkOf(float x, uint32_t chunkCount) {
+    int c = (int)(x / CHUNK_WIDTH);
+    if (x < 0 || c < 0) c = 0;
+    if (c >= (int)chunkCount) c = chunkCount - 1;
+    return c;
+}
+
+static void writeAt(FILE* out, uint64_t offset, const void* data, size_t size) {
+    fseek(out, (long)offset, SEEK_SET);
+    fwrite(data, 1, size, out);
+}
+
+// Split rows of floats into padded columns starting at offset
+static void writeColumns(FILE* out, uint64_t offset, const float* rows, int count, int columns) {
+    for (int c = 0; c < columns; c++) {
+        fseek(out, (long)(offset + c * LEVEL_COLUMN_STRIDE(count)), SEEK_SET);
+        for (int i = 0; i < count; i++) {
+            fwrite(&rows[i * columns + c], sizeof(float), 1, out);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <level.txt> <level.lvl>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = fopen(argv[1], "r");
+    if (!in) {
+        fprintf(stderr, "Unable to open %s!\n", argv[1]);
+        return 1;
+    }
+
+    LevelHeader header = { LEVEL_MAGIC, LEVEL_VERSION, 0, 0, 0, 0, 0, 0 };
+    LevelRect goal = { 0, 0, 0, 0 };
+    bool haveLevel = false, haveGoal = false;
+    int groundTop = 0;
+    List platforms = { NULL, 0, 0, sizeof(LevelPlatform) };
+    List coins = { NULL, 0, 0, sizeof(CoinDef) };
+    List enemies = { NULL, 0, 0, sizeof(EnemyDef) };
+    List grounds = { NULL, 0, 0, sizeof(GroundDef) };
+
+    char line[512];
+    int lineNumber = 0;
+    bool ok = true;
+
+    while (fgets(line, sizeof(line), in)) {
+        lineNumber++;
+
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char keyword[32];
+        int used = 0;
+        if (sscanf(line, " %31s %n", keyword, &used) != 1) continue;
+        const char* args = line + used;
+        int n = 0;
+
+        if (strcmp(keyword, "level") == 0) {
+            n = sscanf(args, "%d %d", &header.width, &header.height);
+            ok = n == 2;
+            haveLevel = true;
+        } else if (strcmp(keyword, "start") == 0) {
+            n = sscanf(args, "%f %f", &header.startX, &header.startY);
+            ok = n == 2;
+        } else if (strcmp(keyword, "goal") == 0) {
+            n = sscanf(args, "%d %d %d %d", &goal.x, &goal.y, &goal.w, &goal.h);
+            ok = n == 4;
+            haveGoal = true;
+        } else if (strcmp(keyword, "ground") == 0) {
+            GroundDef* g = push(&grounds);
+            int top;
+            n = sscanf(args, "%d %d %d", &g->fromX, &g->toX, &top);
+            ok = n == 3;
+            if (ok && grounds.count > 1 && top != groundTop) {
+                fprintf(stderr, "%s:%d: all ground must share one top y\n", argv[1], lineNumber);
+                ok = false;
+            }
+            if (ok && top % LEVEL_TILE_SIZE != 0) {
+                fprintf(stderr, "%s:%d: ground top must be a multiple of %d\n", argv[1], lineNumber, LEVEL_TILE_SIZE);
+                ok = false;
+            }
+            groundTop = top;
+        } else if (strcmp(keyword, "platform") == 0) {
+            LevelPlatform* p = push(&platforms);
+            char kind[16] = "";
+            n = sscanf(args, "%d %d %d %d %15s", &p->x, &p->y, &p->w, &p->h, kind);
+            p->flags = LEVEL_PLATFORM_ACTIVE;
+            if (strcmp(kind, "solid") == 0) p->flags |= LEVEL_PLATFORM_SOLID;
+            if (strcmp(kind, "hazard") == 0) p->flags |= LEVEL_PLATFORM_HAZARD;
+            ok = n == 4 || (n == 5 && p->flags != LEVEL_PLATFORM_ACTIVE);
+            if (ok && (p->x % LEVEL_TILE_SIZE || p->y % LEVEL_TILE_SIZE || p->w % LEVEL_TILE_SIZE || p->h % LEVEL_TILE_SIZE)) {
+                fprintf(stderr, "%s:%d: platform edges must be multiples of %d\n", argv[1], lineNumber, LEVEL_TILE_SIZE);
+                ok = false;
+            }
+            if (ok && p->x >= 0 && p->x + p->w > (p->x / CHUNK_WIDTH + 2) * CHUNK_WIDTH) {
+                fprintf(stderr, "%s:%d: platform reaches past the chunk after its own\n", argv[1], lineNumber);
+                ok = false;
+            }
+        } else if (strcmp(keyword, "coin") == 0) {
+            CoinDef* c = push(&coins);
+            n = sscanf(args, "%f %f %f %f", &c->v[COIN_COLUMN_X], &c->v[COIN_COLUMN_Y],
+                       &c->v[COIN_COLUMN_W], &c->v[COIN_COLUMN_H]);
+            ok = n == 4;
+        } else if (strcmp(keyword, "enemy") == 0) {
+            EnemyDef* e = push(&enemies);
+            char type[16] = "bluebird";
+            n = sscanf(args, "%f %f %f %f %f %f %f %15s", &e->v[ENEMY_COLUMN_X], &e->v[ENEMY_COLUMN_Y],
+                       &e->v[ENEMY_COLUMN_W], &e->v[ENEMY_COLUMN_H], &e->v[ENEMY_COLUMN_VX],
+                       &e->v[ENEMY_COLUMN_PATROL_START], &e->v[ENEMY_COLUMN_PATROL_END], type);
+            ok = n == 7 || n == 8;
+
+            int t = 0;
+            while (t < LEVEL_ENEMY_TYPE_COUNT && strcmp(type, levelEnemyTypeNames[t]) != 0) t++;
+            if (ok && t == LEVEL_ENEMY_TYPE_COUNT) {
+                fprintf(stderr, "%s:%d: unknown enemy type '%s'\n", argv[1], lineNumber, type);
+                ok = false;
+            }
+            e->v[ENEMY_COLUMN_TYPE] = (float)t;
+        } else {
+            fprintf(stderr, "%s:%d: unknown keyword '%s'\n", argv[1], lineNumber, keyword);
+            ok = false;
+        }
+
+        if (!ok) {
+            fprintf(stderr, "%s:%d: bad '%s' line\n", argv[1], lineNumber, keyword);
+            break;
+        }
+    }
+    fclose(in);
+
+    if (ok && (!haveLevel || !haveGoal)) {
+        fprintf(stderr, "%s: needs a 'level' and a 'goal' line\n", argv[1]);
+        ok = false;
+    }
+    if (!ok) return 1;
+
+    if (header.width <= 0) {
+        fprintf(stderr, "%s: level width must be positive\n", argv[1]);
+        return 1;
+    }
+
+    // Bin everything into chunks by its left edge
+    LevelChunkTable table = { CHUNK_WIDTH, (header.width + CHUNK_WIDTH - 1) / CHUNK_WIDTH, coins.count,
+                              GROUND_TILE_SIZE, (float)groundTop, { 0, 0, 0 } };
+    LevelChunk* chunks = calloc(table.chunkCount, sizeof(LevelChunk));
+    List* chunkPlatforms = calloc(table.chunkCount, sizeof(List));
+    List* chunkCoins = calloc(table.chunkCount, sizeof(List));
+    List* chunkEnemies = calloc(table.chunkCount, sizeof(List));
+    uint8_t* groundTiles = calloc((size_t)table.chunkCount * (CHUNK_WIDTH / GROUND_TILE_SIZE), 1);
+    if (!chunks || !chunkPlatforms || !chunkCoins || !chunkEnemies || !groundTiles) {
+        fprintf(stderr, "Out of memory!\n");
+        return 1;
+    }
+
+    for (uint32_t c = 0; c < table.chunkCount; c++) {
+        chunkPlatforms[c].itemSize = sizeof(LevelPlatform);
+        chunkCoins[c].itemSize = sizeof(CoinDef);
+        chunkEnemies[c].itemSize = sizeof(EnemyDef);
+    }
+
+    for (int i = 0; i < platforms.count; i++) {
+        LevelPlatform* p = (LevelPlatform*)platforms.data + i;
+        *(LevelPlatform*)push(&chunkPlatforms[chunkOf(p->x, table.chunkCount)]) = *p;
+    }
+    for (int i = 0; i < coins.count; i++) {
+        CoinDef* c = (CoinDef*)coins.data + i;
+        *(CoinDef*)push(&chunkCoins[chunkOf(c->v[COIN_COLUMN_X], table.chunkCount)]) = *c;
+    }
+    for (int i = 0; i < enemies.count; i++) {
+        EnemyDef* e = (EnemyDef*)enemies.data + i;
+        *(EnemyDef*)push(&chunkEnemies[chunkOf(e->v[ENEMY_COLUMN_X], table.chunkCount)]) = *e;
+    }
+
+    // Ground becomes one row of tiles across the level
+    int groundColumns = table.chunkCount * (CHUNK_WIDTH / GROUND_TILE_SIZE);
+    for (int i = 0; i < grounds.count; i++) {
+        GroundDef* g = (GroundDef*)grounds.data + i;
+        for (int c = g->fromX / GROUND_TILE_SIZE; c * GROUND_TILE_SIZE < g->toX && c < groundColumns; c++) {
+            if (c >= 0) groundTiles[c] = 1;
+        }
+    }
+
+    // Lay out the sections, then the chunk payloads after them
+    LevelSection sections[2];
+    header.sectionCount = 2;
+    uint64_t offset = alignUp(sizeof(LevelHeader) + sizeof(sections));
+
+    sections[0] = (LevelSection){ LEVEL_SECTION_GOAL, 1, offset, sizeof(LevelRect) };
+    offset = alignUp(offset + sections[0].size);
+    sections[1] = (LevelSection){ LEVEL_SECTION_CHUNKS, table.chunkCount, offset,
+                                  sizeof(LevelChunkTable) + table.chunkCount * sizeof(LevelChunk) };
+    offset = alignUp(offset + sections[1].size);
+
+    uint32_t firstCoin = 0;
+    for (uint32_t c = 0; c < table.chunkCount; c++) {
+        LevelChunk* chunk = &chunks[c];
+        chunk->platformCount = chunkPlatforms[c].count;
+        chunk->coinCount = chunkCoins[c].count;
+        chunk->enemyCount = chunkEnemies[c].count;
+        chunk->groundColumns = CHUNK_WIDTH / GROUND_TILE_SIZE;
+        chunk->firstCoin = firstCoin;
+        firstCoin += chunk->coinCount;
+
+        if (chunkPlatforms[c].count > CHUNK_MAX_PLATFORMS || chunkCoins[c].count > CHUNK_MAX_COINS ||
+            chunkEnemies[c].count > CHUNK_MAX_ENEMIES) {
+            fprintf(stderr, "%s: chunk at x=%d holds more than %d platforms, %d coins or %d enemies\n",
+                    argv[1], c * CHUNK_WIDTH, CHUNK_MAX_PLATFORMS, CHUNK_MAX_COINS, CHUNK_MAX_ENEMIES);
+            return 1;
+        }
+
+        LevelChunkLayout layout = levelChunkLayout(chunk->platformCount, chunk->coinCount,
+                                                   chunk->enemyCount, chunk->groundColumns);
+        chunk->offset = offset;
+        chunk->size = (uint32_t)layout.size;
+        offset += layout.size;
+    }
+
+    FILE* out = fopen(argv[2], "wb");
+    if (!out) {
+        fprintf(stderr, "Unable to create %s!\n", argv[2]);
+        return 1;
+    }
+
+    // Padding is zero-filled by writing the last byte first
+    fseek(out, (long)offset - 1, SEEK_SET);
+    fputc(0, out);
+
+    writeAt(out, 0, &header, sizeof(header));
+    writeAt(out, sizeof(header), sections, sizeof(sections));
+    writeAt(out, sections[0].offset, &goal, sizeof(goal));
+    writeAt(out, sections[1].offset, &table, sizeof(table));
+    writeAt(out, sections[1].offset + sizeof(table), chunks, table.chunkCount * sizeof(LevelChunk));
+
+    for (uint32_t c = 0; c < table.chunkCount; c++) {
+        LevelChunk* chunk = &chunks[c];
+        LevelChunkLayout layout = levelChunkLayout(chunk->platformCount, chunk->coinCount,
+                                                   chunk->enemyCount, chunk->groundColumns);
+
+        writeAt(out, chunk->offset + layout.platforms, chunkPlatforms[c].data,
+                chunk->platformCount * sizeof(LevelPlatform));
+        writeColumns(out, chunk->offset + layout.coins, chunkCoins[c].data, chunk->coinCount, COIN_COLUMN_COUNT);
+        writeColumns(out, chunk->offset + layout.enemies, chunkEnemies[c].data, chunk->enemyCount, ENEMY_COLUMN_COUNT);
+        writeAt(out, chunk->offset + layout.ground, groundTiles + (size_t)c * chunk->groundColumns, chunk->groundColumns);
+
+        free(chunkPlatforms[c].data);
+        free(chunkCoins[c].data);
+        free(chunkEnemies[c].data);
+    }
+
+    bool written = !ferror(out);
+    if (fclose(out) != 0) written = false;
+    if (!written) {
+        fprintf(stderr, "Failed writing %s!\n", argv[2]);
+        return 1;
+    }
+
+    printf("%s: %u chunks, %d platforms, %d coins, %d enemies, %llu bytes\n",
+           argv[2], table.chunkCount, platforms.count, coins.count, enemies.count, (unsigned long long)offset);
+
+    free(platforms.data);
+    free(coins.data);
+    free(enemies.data);
+    free(grounds.data);
+    free(groundTiles);
+    free(chunks);
+    free(chunkPlatforms);
+    free(chunkCoins);
+    free(chunkEnemies);
+    return 0;
+}
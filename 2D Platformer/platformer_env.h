@@ -0,0 +1,53 @@
+// Batch simulation API for automated players, built from the game itself:
+//
+//   gcc -O2 -DPLATFORMER_LIB -shared -fPIC 2d_platformer.c -o libplatformer.so -lSDL2 -lSDL2_image
+//
+// An Env holds n independent worlds on levels/level1.lvl, all in one block of
+// memory, and steps every world one fixed game tick per env_step. Nothing is
+// drawn. Worlds are stepped in batches spread over a pool of threads, so
+// env_step returns once every world has advanced.
+//
+// Only one Env can exist at a time, they share the loaded level.
+#ifndef PLATFORMER_ENV_H
+#define PLATFORMER_ENV_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Actions are the same per-tick input bits the game records
+#define ENV_ACTION_LEFT 0x01
+#define ENV_ACTION_RIGHT 0x02
+#define ENV_ACTION_JUMP 0x04
+
+// Observation of one world, in pixels and pixels per tick:
+//   player x, y, vx, vy, on ground (0 or 1)
+//   dx, dy from the player to the ENV_NEAREST closest enemies, nearest first
+//   dx, dy to the ENV_NEAREST closest coins not yet collected
+//   dx, dy to the goal
+// Missing enemies or coins are reported as 0, 0.
+#define ENV_NEAREST 4
+#define ENV_OBS_SIZE (5 + 4 * ENV_NEAREST + 2)
+
+// Rewards: +1 per coin, +10 for reaching the goal, -1 for dying. A world whose
+// episode ended (goal, death, or ENV_MAX_EPISODE_TICKS) reports done and has
+// already been reset, its observation is the start of the next episode.
+#define ENV_MAX_EPISODE_TICKS 3600
+
+typedef struct Env Env;
+
+// NULL if the level or memory can't be had
+Env* env_create(int n);
+void env_destroy(Env* env);
+
+// observations holds n * ENV_OBS_SIZE floats
+void env_reset(Env* env, float* observations);
+
+// actions, rewards and dones hold n entries each. Any output may be NULL
+void env_step(Env* env, const unsigned char* actions, float* observations, float* rewards, unsigned char* dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
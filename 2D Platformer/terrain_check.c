@@ -0,0 +1,97 @@
+// terrain_check: runs the player's terrain movement against small hand-built tile maps and
+// reports any case that moves the player somewhere it shouldn't. Built from the game itself,
+// so it checks the same movePlayer the game runs:
+//
+//   make check
+//
+// or by hand:
+//
+//   gcc terrain_check.c -o terrain_check -lSDL2 -lSDL2_image -lm -lpthread
+//   ./terrain_check
+//
+// Exits with 1 if any check fails.
+#define PLATFORMER_LIB
+#include "2d_platformer.c"
+
+static int failures = 0;
+
+static void check(bool ok, const char* name, const Player* player) {
+    printf("%s %s (player at %.1f, %.1f%s)\n", ok ? "ok  " : "FAIL", name,
+           player->x, player->y, player->onGround ? ", on ground" : "");
+    if (!ok) failures++;
+}
+
+static TileMap map;
+
+// A width x height level with only ground from x = 0 to groundRight, its top at groundY. Every
+// chunk of it is active, chunk c in slot c, like the game's windows after streaming them in
+static void groundMap(int width, int height, int groundRight, int groundY) {
+    freeTileMap(&map);
+    map.columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    map.rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    map.bits = calloc((size_t)MAX_RESIDENT_CHUNKS * TILE_LAYER_COUNT * map.rows * CHUNK_TILE_WORDS, sizeof(Uint64));
+    if (!map.bits) {
+        printf("Out of memory for the tile map!\n");
+        exit(1);
+    }
+    int chunks = (width + CHUNK_WIDTH - 1) / CHUNK_WIDTH;
+    for (int s = 0; s < MAX_RESIDENT_CHUNKS; s++) {
+        if (s < chunks) {
+            clearSlotTiles(&map, s, s);
+            fillTiles(&map, s, TILE_SOLID, 0, groundY, groundRight, height - groundY);
+        } else {
+            map.chunk[s] = -1;
+        }
+    }
+}
+
+static Player playerAt(float x, float y) {
+    return (Player){ .x = x, .y = y, .w = 50, .h = 50 };
+}
+
+int main(void) {
+    // The pit to the right of x = 800 goes below the level, which ends at y = 600
+    groundMap(2000, 600, 800, 525);
+
+    // Walking back into the ledge from anywhere deeper than MAX_STEP_UP is a wall, in the
+    // level or below it, never a landing on the ledge's top
+    bool walled = true;
+    Player player;
+    for (float y = 525 - 50 + MAX_STEP_UP + TILE_SIZE; y <= 800 && walled; y += 1) {
+        player = playerAt(800, y);
+        movePlayer(&map, &player, -5, 14);
+        walled = player.x == 800 && !player.onGround && player.y == y + 14;
+    }
+    check(walled, "the side of a pit is a wall down past the bottom of the level", &player);
+
+    // A player that fell below the level and keeps holding left stays in the pit
+    Player fallen = playerAt(800, 678);
+    for (int tick = 0; tick < 30; tick++) movePlayer(&map, &fallen, -5, 14);
+    check(fallen.x == 800 && !fallen.onGround && fallen.y > 600, "a player below the level can't walk out of the pit", &fallen);
+
+    // Feet less than MAX_STEP_UP under the ledge's top step back up onto it
+    Player stepping = playerAt(800, 475 + MAX_STEP_UP - TILE_SIZE);
+    movePlayer(&map, &stepping, -5, 1);
+    check(stepping.x == 795 && stepping.onGround && stepping.y == 475, "walking back onto a ledge just stepped off lands on it", &stepping);
+
+    // Falling onto the ground lands on its top
+    Player falling = playerAt(400, 400);
+    for (int tick = 0; tick < 20; tick++) movePlayer(&map, &falling, 0, 14);
+    check(falling.onGround && falling.y == 475, "a fall onto the ground lands on its top", &falling);
+
+    // Ground across the boundary between chunks 0 and 1 is split between their windows, and
+    // it's solid the whole way along, on both sides of the boundary and on the cell they share
+    groundMap(2000, 600, 1500, 525);
+    bool across = true;
+    Player walker;
+    for (float x = CHUNK_WIDTH - 100; x <= CHUNK_WIDTH + 50 && across; x += 1) {
+        walker = playerAt(x, 400);
+        for (int tick = 0; tick < 20; tick++) movePlayer(&map, &walker, 0, 14);
+        across = walker.onGround && walker.y == 475;
+    }
+    check(across, "ground across a chunk boundary is solid on both sides of it", &walker);
+
+    freeTileMap(&map);
+    printf("%s\n", failures ? "Terrain checks failed" : "All terrain checks passed");
+    return failures ? 1 : 0;
+}